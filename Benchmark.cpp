@@ -0,0 +1,626 @@
+/** \author Andrew Powell \date July 5th, 2014 */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <cstdio>
+#include "CamShift.h"
+#include "DebugRecorder.h"
+
+using namespace camShift;
+using namespace std;
+
+/* The ways in which the synthetic target moves */
+enum Motion { STATIC, LINEAR, CIRCULAR, JITTER, MOTIONS };
+const char* motionNames[] = { "static", "linear", "circular", "jitter" };
+
+/* Sets a color space, giving BGR eight bins per channel since none of its channels is brightness alone */
+void configureSpace(CamShift& camShift, ColorSpace::Space space) {
+	camShift.setParameter(CamShift::COLOR_SPACE_C, space);
+	if (space == ColorSpace::BGR) {
+		camShift.setParameter(CamShift::HUE_BINS_C, 8);
+		camShift.setParameter(CamShift::SAT_BINS_C, 8);
+		camShift.setParameter(CamShift::VAL_BINS_C, 8);
+	}
+}
+
+/* A configuration of the CamShift class to compare against the reference */
+struct Mode {
+	const char* name;
+	void (*configure)(CamShift& camShift);
+};
+
+const Mode modes[] = {
+	{ "reference", [](CamShift&) { } },
+	{ "shared scratch", [](CamShift& c) { c.setParameter(CamShift::SHARED_SCRATCH_C, 1); } },
+	{ "low memory", [](CamShift& c) { c.setParameter(CamShift::LOW_MEMORY_C, 1); } },
+	{ "planar hsv", [](CamShift& c) { c.setParameter(CamShift::PLANAR_HSV_C, 1); } },
+	{ "look up bins", [](CamShift& c) { c.setParameter(CamShift::LOOK_UP_BINS_C, 1); } },
+	{ "fixed point", [](CamShift& c) { c.setParameter(CamShift::FIXED_POINT_C, 1); } },
+	{ "adaptive filter", [](CamShift& c) { c.setParameter(CamShift::ADAPTIVE_FILTER_C, 48); } },
+	{ "ellipse moments", [](CamShift& c) { c.setParameter(CamShift::ELLIPSE_MOMENTS_C, 1); } },
+	{ "sampled moments", [](CamShift& c) { c.setParameter(CamShift::MOMENT_SAMPLES_C, 4096); } },
+	{ "duty cycle", [](CamShift& c) { c.setParameter(CamShift::DUTY_CYCLE_C, 8); } },
+	{ "background ring", [](CamShift& c) { c.setParameter(CamShift::BACKGROUND_RING_C, 32); } },
+	{ "rg chromaticity", [](CamShift& c) { configureSpace(c, ColorSpace::RG_CHROMATICITY); } },
+	{ "ycrcb", [](CamShift& c) { configureSpace(c, ColorSpace::YCRCB); } },
+	{ "bgr", [](CamShift& c) { configureSpace(c, ColorSpace::BGR); } },
+};
+const int MODES = sizeof(modes) / sizeof(modes[0]);
+
+/* One synthetic scene: a red ellipse moving over a noisy background */
+struct Scene {
+	cv::Size frameSize;
+	float targetFraction;
+	Motion motion;
+};
+
+/* The measurements of one mode over one scene */
+struct Measurement {
+	double fps;
+	double p50;
+	double p99;
+	size_t memory;
+	double centerError;
+	double iou;
+	double truthError;
+	double pixelsVisited;
+	double boundingPixels;
+};
+
+cv::RotatedRect getTarget(const Scene& scene, int frame) {
+	float width = scene.frameSize.width;
+	float height = scene.frameSize.height;
+	float radius = scene.targetFraction * height / 2;
+	cv::Point2f center(width / 2, height / 2);
+	float t = frame / 30.f;
+	switch (scene.motion) {
+	case LINEAR:
+		center.x = radius + (width - 2 * radius) * fabs(fmod(t / 4, 2.f) - 1);
+		break;
+	case CIRCULAR:
+		center.x += (height / 2 - radius) * cos(t);
+		center.y += (height / 2 - radius) * sin(t);
+		break;
+	case JITTER: {
+		cv::RNG rng(frame);
+		center.x += rng.uniform(-radius / 4, radius / 4);
+		center.y += rng.uniform(-radius / 4, radius / 4);
+		break;
+	}
+	default: break;
+	}
+	return cv::RotatedRect(center, cv::Size2f(2 * radius, 1.5f * radius), 20 * sin(t));
+}
+
+void drawFrame(const Scene& scene, int frame, cv::Mat& capturedRawFrame) {
+	cv::RNG rng(frame); // every mode sees identical frames
+	capturedRawFrame.create(scene.frameSize, CV_8UC3);
+	rng.fill(capturedRawFrame, cv::RNG::UNIFORM, cv::Scalar(0, 0, 0), cv::Scalar(90, 90, 90));
+	cv::ellipse(capturedRawFrame, getTarget(scene, frame), cv::Scalar(30, 30, 220), -1);
+}
+
+/* The selection covers the middle of the target, as a user would select it */
+cv::Rect getSelection(const Scene& scene) {
+	cv::Rect selection = getTarget(scene, 0).boundingRect();
+	return cv::Rect(selection.x + selection.width / 4, selection.y + selection.height / 4,
+		selection.width / 2, selection.height / 2);
+}
+
+double getPercentile(vector<double> latencies, double percentile) {
+	size_t index = (size_t)(percentile * (latencies.size() - 1));
+	nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+	return latencies[index];
+}
+
+double getIou(const cv::Rect& a, const cv::Rect& b) {
+	double united = (a | b).area();
+	return united > 0 ? (a & b).area() / united : 1;
+}
+
+/* Runs one mode over one scene, comparing its tracks against the reference tracks if given */
+Measurement runScene(const Mode& mode, const Scene& scene, int frames,
+		vector<cv::RotatedRect>& rotatedTracks, vector<cv::Rect>& tracks, bool isReference) {
+	CamShift camShift;
+	mode.configure(camShift);
+	camShift.prepare(scene.frameSize, CV_8UC3);
+
+	cv::Mat capturedRawFrame;
+	drawFrame(scene, 0, capturedRawFrame);
+	camShift.setCapturedRawFrame(capturedRawFrame);
+	cv::Rect selection = getSelection(scene);
+	camShift.setSelection(selection);
+
+	vector<double> latencies;
+	double totalCenterError = 0;
+	double totalIou = 0;
+	double totalTruthError = 0;
+	double totalPixelsVisited = 0;
+	double totalBoundingPixels = 0;
+	for (int frame = 1; frame <= frames; frame++) {
+		drawFrame(scene, frame, capturedRawFrame);
+
+		int64 start = cv::getTickCount();
+		camShift.setCapturedRawFrame(capturedRawFrame);
+		camShift.runCamShift();
+		latencies.push_back((cv::getTickCount() - start) * 1000. / cv::getTickFrequency());
+		totalPixelsVisited += camShift.getPixelsVisited();
+		totalBoundingPixels += camShift.getBoundingPixels();
+
+		cv::Point2f truthError = camShift.getRotatedTrack().center - getTarget(scene, frame).center;
+		totalTruthError += sqrt(truthError.x * truthError.x + truthError.y * truthError.y);
+		if (isReference) {
+			rotatedTracks.push_back(camShift.getRotatedTrack());
+			tracks.push_back(camShift.getTrack());
+		} else {
+			cv::Point2f error = camShift.getRotatedTrack().center - rotatedTracks[frame - 1].center;
+			totalCenterError += sqrt(error.x * error.x + error.y * error.y);
+			totalIou += getIou(camShift.getTrack(), tracks[frame - 1]);
+		}
+	}
+
+	double totalTime = 0;
+	for (size_t i = 0; i < latencies.size(); i++)
+		totalTime += latencies[i];
+	Measurement measurement;
+	measurement.fps = frames * 1000. / totalTime;
+	measurement.p50 = getPercentile(latencies, 0.5);
+	measurement.p99 = getPercentile(latencies, 0.99);
+	measurement.memory = camShift.getMemoryUsage();
+	measurement.centerError = isReference ? 0 : totalCenterError / frames;
+	measurement.iou = isReference ? 1 : totalIou / frames;
+	measurement.truthError = totalTruthError / frames;
+	measurement.pixelsVisited = totalPixelsVisited / frames;
+	measurement.boundingPixels = totalBoundingPixels / frames;
+	return measurement;
+}
+
+double getDistance(const cv::Point2f& a, const cv::Point2f& b) {
+	cv::Point2f difference = a - b;
+	return sqrt(difference.x * difference.x + difference.y * difference.y);
+}
+
+/* The time one tracker spent on a scene, in milliseconds of wall time per frame and nanoseconds of this thread's CPU time */
+struct TrackTime {
+	double wall;
+	int64_t cpu;
+};
+
+/*
+ * Selects the scene's first frame on each tracker, then tracks every later frame with each tracker in turn, timing
+ * each, and calls compare(frame, capturedRawFrame) once they have all run, so only what is compared differs
+ */
+template <typename Compare>
+void trackSideBySide(const Scene& scene, int frames, cv::Rect selection, CamShift* const* camShifts, int count,
+		TrackTime* times, Compare compare) {
+	cv::Mat capturedRawFrame;
+	drawFrame(scene, 0, capturedRawFrame);
+	for (int i = 0; i < count; i++) {
+		camShifts[i]->setCapturedRawFrame(capturedRawFrame);
+		camShifts[i]->setSelection(selection);
+		times[i].wall = 0;
+		times[i].cpu = 0;
+	}
+	for (int frame = 1; frame <= frames; frame++) {
+		drawFrame(scene, frame, capturedRawFrame);
+		for (int i = 0; i < count; i++) {
+			int64 start = cv::getTickCount();
+			int64_t cpuStart = LatencyHistogram::threadCpuNow();
+			camShifts[i]->setCapturedRawFrame(capturedRawFrame);
+			camShifts[i]->runCamShift();
+			times[i].cpu += LatencyHistogram::threadCpuNow() - cpuStart;
+			times[i].wall += (cv::getTickCount() - start) * 1000. / cv::getTickFrequency() / frames;
+		}
+		compare(frame, capturedRawFrame);
+	}
+}
+
+/* Tracks one scene with dense and subsampled ellipse moments side by side, and reports how far they differ */
+void compareMoments(const Scene& scene, int frames) {
+	CamShift dense;
+	CamShift sampled;
+	dense.setParameter(CamShift::ELLIPSE_MOMENTS_C, 1);
+	sampled.setParameter(CamShift::MOMENT_SAMPLES_C, 4096);
+	CamShift* camShifts[2] = { &dense, &sampled };
+	TrackTime times[2];
+	double totalCenter = 0, maximumCenter = 0, totalAngle = 0, maximumAngle = 0;
+	trackSideBySide(scene, frames, getSelection(scene), camShifts, 2, times, [&](int, const cv::Mat&) {
+		double center = getDistance(sampled.getRotatedTrack().center, dense.getRotatedTrack().center);
+		double angle = fabs(sampled.getRotatedTrack().angle - dense.getRotatedTrack().angle);
+		angle = min(angle, 180 - angle);
+		totalCenter += center;
+		totalAngle += angle;
+		maximumCenter = max(maximumCenter, center);
+		maximumAngle = max(maximumAngle, angle);
+	});
+
+	ostringstream resolution;
+	resolution << scene.frameSize.width << "x" << scene.frameSize.height;
+	cout << left << setw(12) << resolution.str() << setw(8) << scene.targetFraction << right << fixed
+		<< setprecision(2) << setw(10) << times[0].wall << setw(12) << times[1].wall
+		<< setw(9) << times[0].wall / times[1].wall << setw(13) << totalCenter / frames << setw(12) << maximumCenter
+		<< setw(12) << totalAngle / frames << setw(11) << maximumAngle << endl;
+}
+
+/* Tracks one scene at the full rate and duty cycled side by side, and reports the time saved and the accuracy lost */
+void compareDutyCycle(const Scene& scene, int frames) {
+	CamShift full;
+	CamShift duty;
+	duty.setParameter(CamShift::DUTY_CYCLE_C, 8);
+	CamShift* camShifts[2] = { &full, &duty };
+	TrackTime times[2];
+	double fullTruthError = 0, dutyTruthError = 0, deviation = 0;
+	trackSideBySide(scene, frames, getSelection(scene), camShifts, 2, times, [&](int frame, const cv::Mat&) {
+		cv::Point2f truth = getTarget(scene, frame).center;
+		fullTruthError += getDistance(full.getRotatedTrack().center, truth);
+		dutyTruthError += getDistance(duty.getRotatedTrack().center, truth);
+		deviation += getDistance(duty.getRotatedTrack().center, full.getRotatedTrack().center);
+	});
+
+	double saved = duty.getCpuTimeSaved() / 1e9;
+	double spent = times[1].cpu / 1e9;
+	cout << left << setw(10) << motionNames[scene.motion] << right << fixed << setprecision(1)
+		<< setw(13) << 100 * duty.getProcessingRate() << setw(14) << 30 * duty.getProcessingRate()
+		<< setw(10) << 100 * saved / (saved + spent) << setprecision(2) << setw(10) << deviation / frames
+		<< setw(11) << fullTruthError / frames << setw(11) << dutyTruthError / frames << endl;
+}
+
+/* Tracks one scene with and without a background ring, selecting the target's whole bounding box as a user would */
+void compareBackgroundRing(const Scene& scene, int frames) {
+	CamShift plain;
+	CamShift ringed;
+	ringed.setParameter(CamShift::BACKGROUND_RING_C, 32);
+	cv::Rect selection = getTarget(scene, 0).boundingRect() & cv::Rect(cv::Point(0, 0), scene.frameSize);
+	CamShift* camShifts[2] = { &plain, &ringed };
+	TrackTime times[2];
+	double area[2] = { 0, 0 };
+	double truthError[2] = { 0, 0 };
+	trackSideBySide(scene, frames, selection, camShifts, 2, times, [&](int frame, const cv::Mat&) {
+		for (int i = 0; i < 2; i++) {
+			cv::Mat& backprojection = camShifts[i]->getBackprojection();
+			area[i] += (double)cv::countNonZero(backprojection) / backprojection.total();
+			truthError[i] += getDistance(camShifts[i]->getRotatedTrack().center, getTarget(scene, frame).center);
+		}
+	});
+
+	cout << left << setw(10) << motionNames[scene.motion] << right << fixed << setprecision(1)
+		<< setw(10) << 100 * area[0] / frames << setw(10) << 100 * area[1] / frames
+		<< setprecision(2) << setw(10) << times[0].wall << setw(10) << times[1].wall
+		<< setw(11) << truthError[0] / frames << setw(11) << truthError[1] / frames << endl;
+}
+
+/* Tracks one scene in each color space, timing the conversion alone and the whole frame, and measures how well the backprojection separates the target */
+void compareColorSpaces(const Scene& scene, int frames) {
+	cv::Rect selection = getSelection(scene);
+	cv::Mat planes[3];
+	for (int c = 0; c < 3; c++)
+		planes[c].create(scene.frameSize, CV_8UC1);
+	cv::Mat targetMask(scene.frameSize, CV_8UC1);
+	for (int space = 0; space < ColorSpace::SPACES; space++) {
+		CamShift camShift;
+		configureSpace(camShift, (ColorSpace::Space)space);
+		CamShift* camShifts[1] = { &camShift };
+		TrackTime times[1];
+		int64 convertTime = 0;
+		double target = 0, background = 0, truthError = 0;
+		trackSideBySide(scene, frames, selection, camShifts, 1, times, [&](int frame, const cv::Mat& capturedRawFrame) {
+			int64 start = cv::getTickCount();
+			ColorSpace::convertPlanes((ColorSpace::Space)space, capturedRawFrame, planes, 3);
+			convertTime += cv::getTickCount() - start;
+
+			/* The mean backprojection inside and outside the true target, as fractions of the largest weight */
+			targetMask.setTo(cv::Scalar(0));
+			cv::ellipse(targetMask, getTarget(scene, frame), cv::Scalar(255), -1);
+			cv::Mat& backprojection = camShift.getBackprojection();
+			double sums[2] = { 0, 0 }, counts[2] = { 0, 0 };
+			for (int y = 0; y < backprojection.rows; y++) {
+				const uchar* weights = backprojection.ptr<uchar>(y);
+				const uchar* inside = targetMask.ptr<uchar>(y);
+				for (int x = 0; x < backprojection.cols; x++) {
+					sums[inside[x] != 0] += weights[x];
+					counts[inside[x] != 0]++;
+				}
+			}
+			target += sums[1] / max(counts[1], 1.) / 255;
+			background += sums[0] / max(counts[0], 1.) / 255;
+			truthError += getDistance(camShift.getRotatedTrack().center, getTarget(scene, frame).center);
+		});
+
+		double scale = 1000. / cv::getTickFrequency() / frames;
+		cout << left << setw(10) << motionNames[scene.motion] << setw(17) << ColorSpace::getName((ColorSpace::Space)space)
+			<< right << fixed << setprecision(2) << setw(12) << convertTime * scale << setw(10) << times[0].wall
+			<< setprecision(3) << setw(10) << target / frames << setw(10) << background / frames
+			<< setprecision(2) << setw(11) << truthError / frames << endl;
+	}
+}
+
+/* Tracks one scene with a tracker prepared after its selection and one never prepared, and checks they stay identical */
+bool comparePrepare(const Mode& mode, const Scene& scene, int frames) {
+	CamShift plain;
+	CamShift prepared;
+	mode.configure(plain);
+	mode.configure(prepared);
+	cv::Mat capturedRawFrame;
+	drawFrame(scene, 0, capturedRawFrame);
+	cv::Rect selection = getSelection(scene);
+	plain.setCapturedRawFrame(capturedRawFrame);
+	plain.setSelection(selection);
+	prepared.setCapturedRawFrame(capturedRawFrame);
+	prepared.setSelection(selection);
+	prepared.prepare(scene.frameSize, CV_8UC3);
+
+	for (int frame = 1; frame <= frames; frame++) {
+		drawFrame(scene, frame, capturedRawFrame);
+		plain.setCapturedRawFrame(capturedRawFrame);
+		plain.runCamShift();
+		prepared.setCapturedRawFrame(capturedRawFrame);
+		prepared.runCamShift();
+		if (plain.getTrack() != prepared.getTrack())
+			return false;
+		cv::Mat& plainBackprojection = plain.getBackprojection();
+		cv::Mat& preparedBackprojection = prepared.getBackprojection();
+		for (int y = 0; y < plainBackprojection.rows; y++) {
+			if (memcmp(plainBackprojection.ptr(y), preparedBackprojection.ptr(y), plainBackprojection.cols) != 0)
+				return false;
+		}
+	}
+	return true;
+}
+
+/* Times a tracker without and then with a recorder attached, and counts the frames the recorder kept and dropped */
+void compareRecorder(const Scene& scene, int frames) {
+	const char* path = "benchmark-recording.avi";
+	CamShift camShift;
+	cv::Mat capturedRawFrame;
+	drawFrame(scene, 0, capturedRawFrame);
+	cv::Rect selection = getSelection(scene);
+	camShift.setCapturedRawFrame(capturedRawFrame);
+	camShift.setSelection(selection);
+
+	double times[2] = { 0, 0 };
+	int64_t queued = 0, dropped = 0;
+	{
+		DebugRecorder recorder(path, 30, 8);
+		for (int pass = 0; pass < 2; pass++) {
+			camShift.setRecorder(pass == 1 ? &recorder : NULL);
+			for (int frame = 1; frame <= frames; frame++) {
+				drawFrame(scene, pass * frames + frame, capturedRawFrame);
+				int64 start = cv::getTickCount();
+				camShift.setCapturedRawFrame(capturedRawFrame);
+				camShift.runCamShift();
+				times[pass] += cv::getTickCount() - start;
+			}
+		}
+		camShift.setRecorder(NULL);
+		dropped = recorder.getDroppedCount();
+		queued = recorder.getQueuedCount(); // some may still be waiting to be encoded
+		if (recorder.isFailed()) {
+			cout << endl << "recorder: failed to write " << path << ", " << queued - recorder.getRecordedCount()
+				<< " queued frames discarded" << endl;
+		}
+	}
+	remove(path);
+
+	double scale = 1000. / cv::getTickFrequency() / frames;
+	cout << endl << "recorder: " << fixed << setprecision(2) << times[0] * scale << " ms per frame without, "
+		<< times[1] * scale << " ms with, " << queued << " frames queued, " << dropped << " dropped" << endl;
+}
+
+/* Times setSelection() with calcHist() and with the lookup tables over one selection, and checks the histograms match */
+void compareHistograms(cv::Size frameSize, float selectionFraction, int repeats) {
+	Scene scene = { frameSize, 0.5f, STATIC };
+	cv::Mat capturedRawFrame;
+	drawFrame(scene, 0, capturedRawFrame);
+	cv::Size selectionSize(cvRound(frameSize.width * selectionFraction), cvRound(frameSize.height * selectionFraction));
+	cv::Rect selection(cv::Point((frameSize.width - selectionSize.width) / 2, (frameSize.height - selectionSize.height) / 2), selectionSize);
+
+	CamShift reference;
+	CamShift lookUp;
+	lookUp.setParameter(CamShift::LOOK_UP_BINS_C, 1);
+	double times[2];
+	CamShift* camShifts[2] = { &reference, &lookUp };
+	for (int i = 0; i < 2; i++) {
+		camShifts[i]->setCapturedRawFrame(capturedRawFrame);
+		camShifts[i]->setSelection(selection); // warms the buffers and OpenCV's threads
+		int64 start = cv::getTickCount();
+		for (int j = 0; j < repeats; j++)
+			camShifts[i]->setSelection(selection);
+		times[i] = (cv::getTickCount() - start) * 1e6 / cv::getTickFrequency() / repeats;
+	}
+
+	/* The histogram is the last part of a checkpoint */
+	vector<uchar> referenceCheckpoint, lookUpCheckpoint;
+	reference.serialize(referenceCheckpoint);
+	lookUp.serialize(lookUpCheckpoint);
+	size_t histoBytes = reference.getParameter(CamShift::HUE_BINS_C) * reference.getParameter(CamShift::SAT_BINS_C) *
+		max(reference.getParameter(CamShift::VAL_BINS_C), 1L) * sizeof(float);
+	size_t size = referenceCheckpoint.size();
+	bool match = lookUpCheckpoint.size() == size &&
+		memcmp(&referenceCheckpoint[size - histoBytes], &lookUpCheckpoint[size - histoBytes], histoBytes) == 0;
+
+	ostringstream resolution;
+	resolution << frameSize.width << "x" << frameSize.height;
+	cout << left << setw(12) << resolution.str() << right << setw(12) << selection.area() << fixed << setprecision(1)
+		<< setw(13) << times[0] << setw(13) << times[1] << setprecision(2) << setw(9) << times[0] / times[1]
+		<< setw(8) << (match ? "yes" : "no") << endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	/*
+	 * Instructions:
+	 *
+	 * The benchmark runs every mode of the CamShift class over a set of synthetic scenes, which vary in
+	 * resolution, target size and motion. The default configuration of the CamShift class serves as the
+	 * reference. For each mode and scene, a row of the table reports the frame rate, the median and 99th
+	 * percentile latency of setCapturedRawFrame() and runCamShift(), the memory held by the tracker, and
+	 * how far the mode's tracks deviate from the reference's tracks (mean center error in pixels and mean
+	 * intersection over union of the track windows). The last column reports the mean distance of the
+	 * tracks from the synthetic target's true center, so that modes which change the results on purpose
+	 * can be compared for tracking quality. For the ellipse moments modes, the final column reports the
+	 * pixels read per frame by the mean shift as a percentage of those an axis-aligned window would read.
+	 *
+	 * After the table, a second table compares dense and subsampled ellipse moments over the circling
+	 * target: the mean time per frame of each, the speedup, and the mean and largest deviation of the
+	 * subsampled rotated track's center and angle from the dense one's. The benchmark then reports the
+	 * size of a tracker's checkpoint and the time taken to serialize() and restore() it.
+	 *
+	 * A third table compares a tracker with DUTY_CYCLE_C set to 8 against one that processes every frame,
+	 * for each motion of a 1280x720 scene: the percentage of frames processed, the effective processing
+	 * rate of a 30 fps camera, the percentage of the CPU time saved on the tracking thread, the mean 
+	 * deviation of the duty-cycled track from the full-rate track, and the mean distance of each from 
+	 * the true center.
+	 *
+	 * A fourth table times setSelection() over centered selections of growing size, up to the whole of
+	 * a 4K frame, building the histogram with calcHist() and with LOOK_UP_BINS_C's sub-histograms, which
+	 * large selections count on all of OpenCV's threads. It also reports whether the two histograms are
+	 * identical.
+	 *
+	 * A fifth table selects the whole bounding box of the target in each motion of a 1280x720 scene, 
+	 * corners of background included, and compares a tracker with BACKGROUND_RING_C set to 32 against 
+	 * one without: the percentage of the frame the backprojection lights up, the time per frame, and the
+	 * mean distance from the true center. The Tuner program searches BACKGROUND_RING_C on recorded clips.
+	 *
+	 * A sixth table tracks each motion of a 1280x720 scene in every ColorSpace::Space, with BGR given 
+	 * eight bins per channel: the time to convert a frame into planes alone, the time per frame of the 
+	 * whole tracker, the mean backprojection inside and outside the true target as fractions of 255, 
+	 * which show how well the space separates the target from the background, and the mean distance 
+	 * from the true center. The main table also runs each space as a mode.
+	 *
+	 * The benchmark then checks, with LOOK_UP_BINS_C and with FIXED_POINT_C, that a tracker prepare()d 
+	 * after setSelection() produces the same tracks and backprojections as one that was never prepared.
+	 *
+	 * The benchmark then times a 1280x720 tracker without and with a DebugRecorder attached, and reports
+	 * how many frames the recorder queued and how many it dropped because its encoder fell behind.
+	 *
+	 * The optional argument sets the number of frames per scene.
+	 */
+
+	try {
+		int frames = argc > 1 ? atoi(argv[1]) : 200;
+		const cv::Size resolutions[] = { cv::Size(640, 480), cv::Size(1280, 720), cv::Size(1920, 1080) };
+		const float targetFractions[] = { 0.1f, 0.25f, 0.5f };
+
+		cout << left << setw(12) << "resolution" << setw(8) << "target" << setw(10) << "motion"
+			<< setw(16) << "mode" << right << setw(9) << "fps" << setw(9) << "p50 ms" << setw(9) << "p99 ms"
+			<< setw(11) << "memory KB" << setw(10) << "center px" << setw(7) << "IoU" << setw(10) << "truth px" << setw(9) << "visit %" << endl;
+
+		for (int r = 0; r < 3; r++) {
+			for (int t = 0; t < 3; t++) {
+				for (int m = 0; m < MOTIONS; m++) {
+					Scene scene = { resolutions[r], targetFractions[t], (Motion)m };
+					vector<cv::RotatedRect> rotatedTracks;
+					vector<cv::Rect> tracks;
+					for (int i = 0; i < MODES; i++) {
+						Measurement measurement = runScene(modes[i], scene, frames, rotatedTracks, tracks, i == 0);
+						ostringstream resolution;
+						resolution << scene.frameSize.width << "x" << scene.frameSize.height;
+						cout << left << setw(12) << resolution.str() << setw(8) << scene.targetFraction
+							<< setw(10) << motionNames[m] << setw(16) << modes[i].name << right << fixed
+							<< setprecision(1) << setw(9) << measurement.fps
+							<< setprecision(2) << setw(9) << measurement.p50 << setw(9) << measurement.p99
+							<< setw(11) << measurement.memory / 1024
+							<< setw(10) << measurement.centerError << setw(7) << measurement.iou
+							<< setw(10) << measurement.truthError << setw(9);
+						if (measurement.boundingPixels > 0)
+							cout << setprecision(1) << 100 * measurement.pixelsVisited / measurement.boundingPixels << endl;
+						else
+							cout << "-" << endl;
+					}
+				}
+			}
+		}
+
+		cout << endl << left << setw(12) << "resolution" << setw(8) << "target" << right << setw(10) << "dense ms"
+			<< setw(12) << "sampled ms" << setw(9) << "speedup" << setw(13) << "center px" << setw(12) << "max px"
+			<< setw(12) << "angle deg" << setw(11) << "max deg" << endl;
+		for (int r = 0; r < 3; r++) {
+			for (int t = 0; t < 3; t++) {
+				Scene scene = { resolutions[r], targetFractions[t], CIRCULAR };
+				compareMoments(scene, frames);
+			}
+		}
+
+		cout << endl << left << setw(10) << "motion" << right << setw(13) << "processed %" << setw(14) << "fps of 30"
+			<< setw(10) << "saved %" << setw(10) << "center px" << setw(11) << "full px" << setw(11) << "duty px" << endl;
+		for (int m = 0; m < MOTIONS; m++) {
+			Scene scene = { resolutions[1], targetFractions[1], (Motion)m };
+			compareDutyCycle(scene, frames);
+		}
+
+		cout << endl << left << setw(12) << "resolution" << right << setw(12) << "pixels" << setw(13) << "calcHist us"
+			<< setw(13) << "look up us" << setw(9) << "speedup" << setw(8) << "match" << endl;
+		const cv::Size histogramResolutions[] = { resolutions[0], resolutions[2], cv::Size(3840, 2160) };
+		const float selectionFractions[] = { 0.1f, 0.25f, 0.5f, 1.f };
+		for (int r = 0; r < 3; r++) {
+			for (int f = 0; f < 4; f++)
+				compareHistograms(histogramResolutions[r], selectionFractions[f], 20);
+		}
+
+		cout << endl << left << setw(10) << "motion" << right << setw(10) << "bp %" << setw(10) << "ring bp %"
+			<< setw(10) << "ms" << setw(10) << "ring ms" << setw(11) << "truth px" << setw(11) << "ring px" << endl;
+		for (int m = 0; m < MOTIONS; m++) {
+			Scene scene = { resolutions[1], targetFractions[1], (Motion)m };
+			compareBackgroundRing(scene, frames);
+		}
+
+		cout << endl << left << setw(10) << "motion" << setw(17) << "space" << right << setw(12) << "convert ms"
+			<< setw(10) << "frame ms" << setw(10) << "target" << setw(10) << "backgr" << setw(11) << "truth px"
+			<< (ColorSpace::isVectorized() ? "" : "   (scalar)") << endl;
+		for (int m = 0; m < MOTIONS; m++) {
+			Scene scene = { resolutions[1], targetFractions[1], (Motion)m };
+			compareColorSpaces(scene, frames);
+		}
+
+		cout << endl << "prepare after selection:";
+		const char* separator = " ";
+		for (int i = 0; i < MODES; i++) {
+			if (strcmp(modes[i].name, "look up bins") != 0 && strcmp(modes[i].name, "fixed point") != 0)
+				continue;
+			Scene scene = { resolutions[0], targetFractions[1], CIRCULAR };
+			cout << separator << modes[i].name << (comparePrepare(modes[i], scene, frames) ? " identical" : " DIFFERS");
+			separator = ", ";
+		}
+		cout << endl;
+
+		Scene recordedScene = { resolutions[1], targetFractions[1], CIRCULAR };
+		compareRecorder(recordedScene, frames);
+
+		/* Checkpoints a tracker repeatedly, as a supervisor would for a standby tracker */
+		Scene scene = { resolutions[0], targetFractions[1], STATIC };
+		cv::Mat capturedRawFrame;
+		drawFrame(scene, 0, capturedRawFrame);
+		CamShift original;
+		original.setCapturedRawFrame(capturedRawFrame);
+		cv::Rect selection = getSelection(scene);
+		original.setSelection(selection);
+		original.runCamShift();
+		CamShift standby;
+		vector<uchar> checkpoint;
+		const int repeats = 1000;
+		int64 start = cv::getTickCount();
+		for (int i = 0; i < repeats; i++)
+			original.serialize(checkpoint);
+		double serializeTime = (cv::getTickCount() - start) * 1e6 / cv::getTickFrequency() / repeats;
+		start = cv::getTickCount();
+		for (int i = 0; i < repeats; i++)
+			standby.restore(&checkpoint[0], checkpoint.size());
+		double restoreTime = (cv::getTickCount() - start) * 1e6 / cv::getTickFrequency() / repeats;
+		cout << endl << "checkpoint: " << checkpoint.size() << " bytes, serialize " << setprecision(2) 
+			<< serializeTime << " us, restore " << restoreTime << " us" << endl;
+
+	/* Report any errors */
+	} catch (exception& e) {
+		cout << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
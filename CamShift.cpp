@@ -1,13 +1,79 @@
 /** \author Andrew Powell \date 6/4/2014 */
 
 #include "CamShift.h"
+#include "DebugRecorder.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+	/* The parameters that are 0 or 1, which a checkpoint packs into bits in this order; new ones go last */
+	const camShift::CamShift::Parameter flagParameters[] = {
+		camShift::CamShift::SHARED_SCRATCH_C,
+		camShift::CamShift::LOW_MEMORY_C,
+		camShift::CamShift::PLANAR_HSV_C,
+		camShift::CamShift::LOOK_UP_BINS_C,
+		camShift::CamShift::FIXED_POINT_C,
+		camShift::CamShift::PERF_COUNTERS_C,
+		camShift::CamShift::ELLIPSE_MOMENTS_C
+	};
+	const int FLAG_PARAMETERS = sizeof(flagParameters) / sizeof(flagParameters[0]);
+
+	/* A checkpoint's fields ahead of its histogram: 27 fields of 32 bits and the 64-bit sequence number */
+	const size_t CHECKPOINT_HEADER_SIZE = 27 * sizeof(int32_t) + sizeof(int64_t);
+
+	/* The fields of a checkpoint are packed, so they are copied rather than accessed in place */
+	template <typename T> void putField(uchar*& out, T value) {
+		memcpy(out, &value, sizeof(T));
+		out += sizeof(T);
+	}
+
+	template <typename T> T getField(const uchar*& in) {
+		T value;
+		memcpy(&value, in, sizeof(T));
+		in += sizeof(T);
+		return value;
+	}
+}
 
 namespace camShift {
 
 	CamShift::CamShift() : 
+			recorder(NULL),
+			sharedScratch(false),
+			lowMemory(false),
+			planarHsv(false),
+			lookUpBins(false),
+			fixedPoint(false),
+			ellipseMoments(false),
+			momentSamples(0),
+			ellipseSelectionCount(0),
+			pixelsVisited(0),
+			boundingPixels(0),
+			dutyCycle(0),
+			dutyStride(1),
+			dutySkipped(0),
+			dutySelectionCount(-1),
+			dutyDensity(0),
+			framesProcessed(0),
+			framesExtrapolated(0),
+			processingTime(0),
+			extrapolationTime(0),
+			adaptiveFilterSize(0),
+			backgroundRing(0),
+			colorSpace(ColorSpace::HSV),
 			medianBlurAmount(MEDIAN_BLUR),
-			thresholdAmount(THRESHOLD) {
+			thresholdAmount(THRESHOLD),
+			selectionCount(0),
+			weightsCount(0) {
 	
+		frameTimes.sequence = frameTimes.captureTime = frameTimes.startTime = frameTimes.completionTime = 0;
+		publishedFrameTimes = frameTimes;
+		for (int i = 0; i < 3; i++) {
+			trackStates.getSlot(i).times = frameTimes;
+			trackStates.getSlot(i).extrapolated = false;
+		}
 		histoRanges[HUE][MINI] = HUE_MIN;
 		histoRanges[HUE][MAXI] = HUE_MAX;
 		histoRanges[SAT][MINI] = SAT_MIN;
@@ -19,8 +85,11 @@ namespace camShift {
 		histoBins[HUE] = HUE_BINS;
 		histoBins[SAT] = SAT_BINS;
 		histoBins[VAL] = VAL_BINS;
-		for (int i = 0; i < CHANNELS; i++)
+		for (int i = 0; i < CHANNELS; i++) {
 			channels[i] = i;
+			constantHistoRanges[i] = histoRanges[i];
+		}
+		setBinTables();
 
 		erosionElement = (cv::Mat_<uchar>(3,3) << 
 			0,1,0,
@@ -38,40 +107,693 @@ namespace camShift {
 
 	CamShift::~CamShift() { }
 
+#ifdef CAMSHIFT_EXCEPTIONS
 	void CamShift::setSelection(cv::Rect& selection) {
-		if (selection.height <= 0 || selection.width <= 0)
-			throw std::runtime_error("Invalid selection");
-		setHsvFrame();
-		cv::Mat regionOfInterestFrame(hsvFrame, selection);
-		cv::Mat maskOfMaskFrame(maskFrame, selection);
-		cv::calcHist(
-			&regionOfInterestFrame, 1, 
-			channels, 
-			maskOfMaskFrame, 
-			histoFrame, CHANNELS, histoBins, getConstantHistoRanges());
+		throwStatus(checkSelection(selection));
+		selectHistogram(selection);
+	}
+#endif
+
+	CamShift::Status CamShift::trySetSelection(const cv::Rect& selection) noexcept {
+		Status status = checkSelection(selection);
+		if (status != OK)
+			return status;
+		return guard([&]() { selectHistogram(selection); });
+	}
+
+	void CamShift::selectHistogram(const cv::Rect& selection) {
+		/* The new tables are only committed with the histogram, so a failed selection leaves the old ones in use */
+		int tables[CHANNELS][256];
+		int count = buildBinTables(tables);
+
+		/* With a background ring, the frames are read over the selection and its ring */
+		cv::Rect area = selection;
+		if (backgroundRing > 0) {
+			area = cv::Rect(selection.x - backgroundRing, selection.y - backgroundRing,
+				selection.width + 2 * backgroundRing, selection.height + 2 * backgroundRing) &
+				cv::Rect(0, 0, capturedRawFrame.cols, capturedRawFrame.rows);
+		}
+		cv::Mat regionOfInterestFrames[CHANNELS];
+		cv::Mat maskOfMaskFrame;
+		int frameCount = 1;
+		if (lowMemory) {
+			Scratch& scratch = setHsvFrame(area);
+			regionOfInterestFrames[0] = scratch.hsvStrip;
+			maskOfMaskFrame = scratch.maskStrip;
+		} else if (planarHsv) {
+			frameCount = getPlaneCount(histoBins[VAL]);
+			Scratch& scratch = setHsvPlanes(frameCount);
+			for (int i = 0; i < frameCount; i++)
+				regionOfInterestFrames[i] = cv::Mat(scratch.hsvPlanes[i], area);
+			if (scratch.planesMasked)
+				maskOfMaskFrame = cv::Mat(scratch.maskFrame, area);
+		} else {
+			Scratch& scratch = setHsvFrame();
+			regionOfInterestFrames[0] = cv::Mat(scratch.hsvFrame, area);
+			maskOfMaskFrame = cv::Mat(scratch.maskFrame, area);
+		}
+
+		if (area == selection) {
+			calcHistogram(regionOfInterestFrames, frameCount, maskOfMaskFrame, tables, count, selectedHistoFrame);
+		} else {
+			cv::Mat areaHisto;
+			calcHistogram(regionOfInterestFrames, frameCount, maskOfMaskFrame, tables, count, areaHisto);
+			cv::Rect inner(selection.x - area.x, selection.y - area.y, selection.width, selection.height);
+			for (int i = 0; i < frameCount; i++)
+				regionOfInterestFrames[i] = cv::Mat(regionOfInterestFrames[i], inner);
+			if (!maskOfMaskFrame.empty())
+				maskOfMaskFrame = cv::Mat(maskOfMaskFrame, inner);
+			calcHistogram(regionOfInterestFrames, frameCount, maskOfMaskFrame, tables, count, selectedHistoFrame);
+			weighHistogram(selectedHistoFrame, areaHisto);
+		}
+		std::swap(histoFrame, selectedHistoFrame); // the old histogram's storage is reused by the next selection
+		memcpy(binTables, tables, sizeof(binTables));
+		binCount = count;
+		setBinWeights();
 		track = selection;
+		selectionCount++;
+	}
+
+	void CamShift::calcHistogram(const cv::Mat* frames, int frameCount, const cv::Mat& mask, const int (*tables)[256], int count, cv::Mat& histogram) {
+		if (lookUpBins || fixedPoint) {
+			calcHistLut(frames, frameCount, tables, count, histogram);
+		} else {
+			int dims = frameCount == 1 ? CHANNELS : frameCount;
+			histogram.create(CHANNELS, histoBins, CV_32F);
+			cv::Mat view(dims, histoBins, CV_32F, histogram.data); // same layout while VAL has 1 bin
+			cv::calcHist(
+				frames, frameCount, 
+				channels, 
+				mask, 
+				view, dims, histoBins, getConstantHistoRanges());
+		}
+	}
+
+	void CamShift::weighHistogram(cv::Mat& histogram, const cv::Mat& areaHisto) {
+		/* Each bin keeps its count times the share of its color's density that lies inside the selection */
+		float* histo = histogram.ptr<float>();
+		const float* areaCounts = areaHisto.ptr<float>();
+		size_t bins = histogram.total();
+		double selectionPixels = 0;
+		double areaPixels = 0;
+		for (size_t bin = 0; bin < bins; bin++) {
+			selectionPixels += histo[bin];
+			areaPixels += areaCounts[bin];
+		}
+		double ringPixels = areaPixels - selectionPixels;
+		if (selectionPixels <= 0 || ringPixels <= 0)
+			return;
+		float largest = 0;
+		for (size_t bin = 0; bin < bins; bin++) {
+			double inside = histo[bin] / selectionPixels;
+			double outside = (areaCounts[bin] - histo[bin]) / ringPixels;
+			if (inside > 0)
+				histo[bin] = (float)(histo[bin] * inside / (inside + outside));
+			largest = std::max(largest, histo[bin]);
+		}
+		for (size_t bin = 0; bin < bins; bin++)
+			histo[bin] *= UCHAR_MAX / largest;
 	}
 
 	void CamShift::setCapturedRawFrame(cv::Mat& capturedRawFrame) {
+		setCapturedRawFrame(capturedRawFrame, 0);
+	}
+
+	void CamShift::setCapturedRawFrame(cv::Mat& capturedRawFrame, int64_t captureTime) {
+		setCapturedRawFrame(capturedRawFrame, captureTime, frameTimes.sequence + 1);
+	}
+
+	void CamShift::setCapturedRawFrame(cv::Mat& capturedRawFrame, int64_t captureTime, int64_t sequence) {
 		this->capturedRawFrame = capturedRawFrame;
+		frameTimes.sequence = sequence;
+		frameTimes.captureTime = captureTime;
+		cv::Size newFrameSize = capturedRawFrame.size();
+		if (capturedFrameSize.area() > 0 && newFrameSize.area() > 0 && newFrameSize != capturedFrameSize)
+			rescaleTrack(capturedFrameSize, newFrameSize);
+		if (newFrameSize.area() > 0)
+			capturedFrameSize = newFrameSize;
+	}
+
+	void CamShift::rescaleTrack(cv::Size oldFrameSize, cv::Size newFrameSize) {
+		float scaleX = (float)newFrameSize.width / oldFrameSize.width;
+		float scaleY = (float)newFrameSize.height / oldFrameSize.height;
+		if (track.area() > 0) {
+			track = cv::Rect(
+				cvRound(track.x * scaleX), 
+				cvRound(track.y * scaleY),
+				std::max(cvRound(track.width * scaleX), 1), 
+				std::max(cvRound(track.height * scaleY), 1)) &
+				cv::Rect(0, 0, newFrameSize.width, newFrameSize.height);
+		}
+
+		/* The rotated track's sides are scaled along their own directions */
+		float radians = (float)(trackRotated.angle * CV_PI / 180);
+		float cosine = std::cos(radians);
+		float sine = std::sin(radians);
+		trackRotated.center.x *= scaleX;
+		trackRotated.center.y *= scaleY;
+		trackRotated.size.width *= std::sqrt(scaleX * scaleX * cosine * cosine + scaleY * scaleY * sine * sine);
+		trackRotated.size.height *= std::sqrt(scaleX * scaleX * sine * sine + scaleY * scaleY * cosine * cosine);
+		dutySelectionCount = -1; // the velocity and backprojection belong to the old resolution
 	}
 
+#ifdef CAMSHIFT_EXCEPTIONS
 	void CamShift::runCamShift() {
-		setHsvFrame();
-		cv::calcBackProject(&hsvFrame, 1, 
+		throwStatus(checkFrame());
+		processFrame();
+	}
+#endif
+
+	CamShift::Status CamShift::tryRunCamShift(TrackResult& result) noexcept {
+		Status status = checkFrame();
+		bool extrapolated = false;
+		if (status == OK)
+			status = guard([&]() { extrapolated = processFrame(); });
+		if (status != OK)
+			return status;
+		result.track = track;
+		result.rotatedTrack = trackRotated;
+		result.times = frameTimes;
+		result.extrapolated = extrapolated;
+		return OK;
+	}
+
+	bool CamShift::processFrame() {
+		int64_t cpuStart = dutyCycle > 0 ? LatencyHistogram::threadCpuNow() : 0; // a system call, so only when counted
+		frameTimes.startTime = LatencyHistogram::now();
+		bool extrapolated = extrapolateTrack();
+		if (!extrapolated) {
+			updateTrack();
+			updateDutyCycle();
+		}
+		publishTrackState(extrapolated);
+		if (dutyCycle > 0)
+			countFrame(extrapolated, LatencyHistogram::threadCpuNow() - cpuStart);
+		if (recorder != NULL)
+			recorder->record(capturedRawFrame, backProjectionFrame, trackRotated, frameTimes.sequence);
+		return extrapolated;
+	}
+
+	void CamShift::countFrame(bool extrapolated, int64_t cpuTime) {
+		if (extrapolated) {
+			framesExtrapolated++;
+			extrapolationTime += cpuTime;
+		} else {
+			framesProcessed++;
+			processingTime += cpuTime;
+		}
+	}
+
+	bool CamShift::extrapolateTrack() {
+		if (dutyCycle == 0 || dutySelectionCount != selectionCount || backProjectionFrame.empty())
+			return false;
+		if (++dutySkipped >= dutyStride)
+			return false;
+		cv::Point2f center = dutyCenter + dutyVelocity * (float)dutySkipped;
+		if (center.x > 0 && center.x <= backProjectionFrame.cols && center.y > 0 && center.y <= backProjectionFrame.rows)
+			trackRotated.center = center;
+		track = trackRotated.boundingRect() & 
+			cv::Rect(0, 0, backProjectionFrame.cols, backProjectionFrame.rows);
+
+		/* The back buffer publishes the latest backprojection again; its own storage is kept for a later frame */
+		cv::Mat& backprojection = trackStates.getBack().backprojection;
+		if (!backprojection.empty() && backprojection.datastart != backProjectionFrame.datastart && !isPublished(backprojection))
+			spareBackprojections.push_back(backprojection);
+		return true;
+	}
+
+	void CamShift::updateDutyCycle() {
+		if (dutyCycle == 0)
+			return;
+		double density = track.area() > 0 ? cv::mean(backProjectionFrame(track))[0] : 0;
+		if (dutySelectionCount != selectionCount || dutySkipped == 0) {
+			dutyVelocity = cv::Point2f(0, 0);
+			dutyDensity = density;
+			dutyStride = 1;
+			dutySelectionCount = selectionCount;
+		} else {
+			cv::Point2f error = trackRotated.center - (dutyCenter + dutyVelocity * (float)dutySkipped);
+			float tolerance = std::min(trackRotated.size.width, trackRotated.size.height) / PREDICTION_TOLERANCE;
+			if (error.x * error.x + error.y * error.y > tolerance * tolerance || density < dutyDensity / 2) {
+				dutyStride = 1;
+			} else {
+				dutyStride = std::min(dutyStride * 2, dutyCycle);
+				dutyDensity += (density - dutyDensity) / 8;
+			}
+			dutyVelocity = (trackRotated.center - dutyCenter) * (1.f / dutySkipped);
+		}
+		dutyCenter = trackRotated.center;
+		dutySkipped = 0;
+	}
+
+	double CamShift::getProcessingRate() {
+		int64_t frames = framesProcessed + framesExtrapolated;
+		return frames > 0 ? (double)framesProcessed / frames : 1;
+	}
+
+	int64_t CamShift::getCpuTimeSaved() {
+		if (framesProcessed == 0)
+			return 0;
+		return (int64_t)((double)processingTime / framesProcessed * framesExtrapolated) - extrapolationTime;
+	}
+
+	const CamShift::FrameTimes& CamShift::getFrameTimes() {
+		return publishedFrameTimes;
+	}
+
+	LatencyHistogram& CamShift::getRunLatency() {
+		return runLatency;
+	}
+
+	LatencyHistogram& CamShift::getCaptureAge() {
+		return captureAge;
+	}
+
+	PerfCounters& CamShift::getPerfCounters() {
+		return perfCounters;
+	}
+
+	void CamShift::setRecorder(DebugRecorder* recorder) {
+		this->recorder = recorder;
+	}
+
+	int64_t CamShift::getPixelsVisited() {
+		return pixelsVisited;
+	}
+
+	int64_t CamShift::getBoundingPixels() {
+		return boundingPixels;
+	}
+
+#ifdef CAMSHIFT_EXCEPTIONS
+	void CamShift::prepare(cv::Size frameSize, int pixelFormat) {
+		throwStatus(checkFormat(frameSize, pixelFormat));
+		allocateBuffers(frameSize, pixelFormat);
+	}
+#endif
+
+	CamShift::Status CamShift::tryPrepare(cv::Size frameSize, int pixelFormat) noexcept {
+		Status status = checkFormat(frameSize, pixelFormat);
+		if (status != OK)
+			return status;
+		return guard([&]() { allocateBuffers(frameSize, pixelFormat); });
+	}
+
+	void CamShift::allocateBuffers(cv::Size frameSize, int pixelFormat) {
+
+		/* 
+		 * Preserve the current state, since the dummy pass below overwrites it. Besides the histogram, that
+		 * includes everything derived from it and the counters that tell the duty cycle, the ellipse and
+		 * MultiCamShift that the selection changed, so a tracker prepared after setSelection() carries on
+		 * with its own weights and caches.
+		 */
+		cv::Mat savedCapturedRawFrame = capturedRawFrame;
+		cv::Mat savedHistoFrame = histoFrame;
+		cv::Mat savedBackProjectionFrame = backProjectionFrame;
+		cv::Rect savedTrack = track;
+		cv::RotatedRect savedTrackRotated = trackRotated;
+		int savedBinTables[CHANNELS][256];
+		memcpy(savedBinTables, binTables, sizeof(binTables));
+		int savedBinCount = binCount;
+		std::vector<uchar> savedBinWeights;
+		savedBinWeights.swap(binWeights);
+		long savedSelectionCount = selectionCount;
+		long savedWeightsCount = weightsCount;
+		long savedEllipseSelectionCount = ellipseSelectionCount;
+		int64_t savedPixelsVisited = pixelsVisited;
+		int64_t savedBoundingPixels = boundingPixels;
+		histoFrame = cv::Mat();
+
+		/* Allocate and touch every published backprojection, of which there are none in strips */
+		for (int i = 0; i < 3 && !lowMemory; i++) {
+			cv::Mat& backprojection = trackStates.getSlot(i).backprojection;
+			resizeView(backprojection, frameSize, CV_8UC1);
+			backprojection = cv::Scalar(0);
+		}
+		for (size_t i = 0; i < spareBackprojections.size(); i++) {
+			resizeView(spareBackprojections[i], frameSize, CV_8UC1);
+			spareBackprojections[i] = cv::Scalar(0);
+		}
+
+		/* A dummy pass allocates and touches the per-frame buffers and initializes OpenCV's internals */
+		capturedRawFrame = cv::Mat(frameSize, pixelFormat, cv::Scalar(0, 0, 0));
+		cv::Rect selection(0, 0, std::min(frameSize.width, (int)WIDTH_MINI), std::min(frameSize.height, (int)HEIGHT_MAXI));
+		selectHistogram(selection);
+		updateTrack();
+
+		capturedRawFrame = savedCapturedRawFrame;
+		histoFrame = savedHistoFrame;
+		backProjectionFrame = savedBackProjectionFrame;
+		track = savedTrack;
+		trackRotated = savedTrackRotated;
+		memcpy(binTables, savedBinTables, sizeof(binTables));
+		binCount = savedBinCount;
+		binWeights.swap(savedBinWeights);
+		selectionCount = savedSelectionCount;
+		weightsCount = savedWeightsCount;
+		ellipseSelectionCount = savedEllipseSelectionCount;
+		pixelsVisited = savedPixelsVisited;
+		boundingPixels = savedBoundingPixels;
+	}
+
+	size_t CamShift::getSerializedSize() {
+		return CHECKPOINT_HEADER_SIZE + (histoFrame.empty() ? 0 : histoFrame.total() * sizeof(float));
+	}
+
+#ifdef CAMSHIFT_EXCEPTIONS
+	size_t CamShift::serialize(uchar* checkpoint, size_t size) {
+		if (size < getSerializedSize())
+			throw std::runtime_error("Checkpoint buffer is too small");
+		uchar* out = checkpoint;
+		putField<int32_t>(out, CHECKPOINT_MAGIC);
+		putField<int32_t>(out, CHECKPOINT_VERSION);
+		for (int c = 0; c < CHANNELS; c++)
+			putField<int32_t>(out, histoBins[c]);
+		putField<int32_t>(out, medianBlurAmount);
+		putField<int32_t>(out, thresholdAmount);
+		putField<int32_t>(out, adaptiveFilterSize);
+		putField<int32_t>(out, momentSamples);
+		putField<int32_t>(out, dutyCycle);
+		putField<int32_t>(out, backgroundRing);
+		putField<int32_t>(out, colorSpace);
+		int32_t flags = 0;
+		for (int i = 0; i < FLAG_PARAMETERS; i++)
+			flags |= (getParameter(flagParameters[i]) != 0) << i;
+		putField<int32_t>(out, flags);
+		putField<int32_t>(out, capturedFrameSize.width);
+		putField<int32_t>(out, capturedFrameSize.height);
+		putField<int32_t>(out, track.x);
+		putField<int32_t>(out, track.y);
+		putField<int32_t>(out, track.width);
+		putField<int32_t>(out, track.height);
+		putField<float>(out, trackRotated.center.x);
+		putField<float>(out, trackRotated.center.y);
+		putField<float>(out, trackRotated.size.width);
+		putField<float>(out, trackRotated.size.height);
+		putField<float>(out, trackRotated.angle);
+		putField<int64_t>(out, frameTimes.sequence);
+		for (int c = 0; c < CHANNELS; c++)
+			putField<int32_t>(out, histoFrame.empty() ? 0 : histoFrame.size[c]);
+		if (!histoFrame.empty()) {
+			memcpy(out, histoFrame.ptr(), histoFrame.total() * sizeof(float));
+			out += histoFrame.total() * sizeof(float);
+		}
+		return out - checkpoint;
+	}
+
+	void CamShift::serialize(std::vector<uchar>& checkpoint) {
+		checkpoint.resize(getSerializedSize());
+		serialize(&checkpoint[0], checkpoint.size());
+	}
+
+	void CamShift::restore(const uchar* checkpoint, size_t size) {
+		if (size < CHECKPOINT_HEADER_SIZE)
+			throw std::runtime_error("Checkpoint is truncated");
+		const uchar* in = checkpoint;
+		if (getField<int32_t>(in) != CHECKPOINT_MAGIC || getField<int32_t>(in) != CHECKPOINT_VERSION)
+			throw std::runtime_error("Checkpoint was not written by this version of the CamShift class");
+		int bins[CHANNELS];
+		for (int c = 0; c < CHANNELS; c++)
+			bins[c] = getField<int32_t>(in);
+		int medianBlur = getField<int32_t>(in);
+		int threshold = getField<int32_t>(in);
+		int adaptiveFilter = getField<int32_t>(in);
+		int samples = getField<int32_t>(in);
+		int duty = getField<int32_t>(in);
+		int ring = getField<int32_t>(in);
+		int space = getField<int32_t>(in);
+		int flags = getField<int32_t>(in);
+		cv::Size frameSize;
+		frameSize.width = getField<int32_t>(in);
+		frameSize.height = getField<int32_t>(in);
+		cv::Rect restoredTrack;
+		restoredTrack.x = getField<int32_t>(in);
+		restoredTrack.y = getField<int32_t>(in);
+		restoredTrack.width = getField<int32_t>(in);
+		restoredTrack.height = getField<int32_t>(in);
+		cv::RotatedRect restoredTrackRotated;
+		restoredTrackRotated.center.x = getField<float>(in);
+		restoredTrackRotated.center.y = getField<float>(in);
+		restoredTrackRotated.size.width = getField<float>(in);
+		restoredTrackRotated.size.height = getField<float>(in);
+		restoredTrackRotated.angle = getField<float>(in);
+		int64_t sequence = getField<int64_t>(in);
+		int histoSizes[CHANNELS];
+		bool histoEmpty = true;
+		for (int c = 0; c < CHANNELS; c++) {
+			histoSizes[c] = getField<int32_t>(in);
+			histoEmpty = histoEmpty && histoSizes[c] == 0;
+		}
+
+		/* The same bound as setParameter(), so any checkpoint of a valid tracker restores */
+		if (!histoEmpty && !areBinsValid(histoSizes))
+			throw std::runtime_error("Checkpoint holds an invalid histogram");
+		size_t histoTotal = histoEmpty ? 0 : (size_t)histoSizes[HUE] * histoSizes[SAT] * histoSizes[VAL];
+		if (size != CHECKPOINT_HEADER_SIZE + histoTotal * sizeof(float))
+			throw std::runtime_error("Checkpoint's size does not match its histogram");
+		if (!areBinsValid(bins) || medianBlur <= 1 || medianBlur % 2 != 1 || threshold < 0 || threshold > THRESHOLD_MAXI || 
+				(adaptiveFilter != 0 && adaptiveFilter < 8) || (samples != 0 && samples < 256) ||
+				(duty != 0 && duty < 2) || ring < 0 || space < 0 || space >= ColorSpace::SPACES || flags < 0 || flags >= (1 << FLAG_PARAMETERS) ||
+				frameSize.width < 0 || frameSize.height < 0)
+			throw std::runtime_error("Checkpoint holds invalid parameters");
+
+		/* Every field is valid, so the state is replaced without failing part way */
+		setParameter(MEDIAN_BLUR_C, medianBlur);
+		setParameter(THRESHOLD_C, threshold);
+		setParameter(ADAPTIVE_FILTER_C, adaptiveFilter);
+		setParameter(MOMENT_SAMPLES_C, samples);
+		setParameter(DUTY_CYCLE_C, duty);
+		setParameter(BACKGROUND_RING_C, ring);
+		setParameter(COLOR_SPACE_C, space);
+		for (int i = 0; i < FLAG_PARAMETERS; i++)
+			setParameter(flagParameters[i], (flags >> i) & 1);
+		capturedFrameSize = frameSize;
+		track = restoredTrack;
+		trackRotated = restoredTrackRotated;
+		frameTimes.sequence = sequence;
+		if (histoTotal > 0) {
+			histoFrame = cv::Mat(CHANNELS, histoSizes, CV_32F);
+			memcpy(histoFrame.ptr(), in, histoTotal * sizeof(float));
+
+			/* The lookup tables follow the histogram's own bins, which were the bins when it was selected */
+			for (int c = 0; c < CHANNELS; c++)
+				histoBins[c] = histoSizes[c];
+			setBinTables();
+			setBinWeights();
+		} else {
+			histoFrame = cv::Mat();
+		}
+		for (int c = 0; c < CHANNELS; c++)
+			histoBins[c] = bins[c];
+		selectionCount++;
+	}
+#endif
+
+	void CamShift::updateTrack() {
+		claimBackBuffer(capturedRawFrame.size());
+		if (lowMemory) {
+			backProjectStrips();
+		} else if (planarHsv) {
+			Scratch& scratch = setHsvPlanes(getPlaneCount(histoFrame.size[VAL]));
+			backProjectPlanes(scratch, backProjectionFrame);
+			filterBackprojection(backProjectionFrame);
+		} else {
+			Scratch& scratch = setHsvFrame();
+			backProject(scratch.hsvFrame, scratch.maskFrame, backProjectionFrame);
+			filterBackprojection(backProjectionFrame);
+		}
+		trackBackprojection();
+	}
+
+	void CamShift::claimBackBuffer(cv::Size frameSize) {
+		if (lowMemory) {
+			resizeView(stripsBackprojection, frameSize, CV_8UC1);
+			backProjectionFrame = stripsBackprojection;
+			return;
+		}
+
+		/* The back buffer's storage is reused, unless an extrapolated state still publishes it */
+		cv::Mat& backprojection = trackStates.getBack().backprojection;
+		if (!backprojection.empty() && isPublished(backprojection)) {
+			if (spareBackprojections.empty()) {
+				backprojection = cv::Mat();
+			} else {
+				backprojection = spareBackprojections.back();
+				spareBackprojections.pop_back();
+			}
+		}
+		backProjectionFrame = backprojection;
+		resizeView(backProjectionFrame, frameSize, CV_8UC1);
+	}
+
+	bool CamShift::isPublished(const cv::Mat& backprojection) {
+		/* Only the writer modifies the slots, so it may read the ones the reader holds */
+		const TrackState* back = &trackStates.getBack();
+		for (int i = 0; i < 3; i++) {
+			const TrackState& state = trackStates.peek(i);
+			if (&state != back && state.backprojection.datastart == backprojection.datastart)
+				return true;
+		}
+		return false;
+	}
+
+	void CamShift::backProject(cv::Mat& hsv, cv::Mat& mask, cv::Mat& backprojection) {
+		PerfCounters::Scope scope(perfCounters, PerfCounters::BACKPROJECT);
+		if (lookUpBins || fixedPoint) {
+			backProjectLut(&hsv, 1, backprojection);
+			return;
+		}
+		cv::calcBackProject(&hsv, 1, 
 			channels, 
 			histoFrame, 
-			backProjectionFrame, 
+			backprojection, 
 			getConstantHistoRanges());
-		backProjectionFrame &= maskFrame; // intersection between bpf and mf? This might be useless
-		cv::threshold(backProjectionFrame, backProjectionFrame, thresholdAmount, 255, cv::THRESH_BINARY);
-		cv::medianBlur(backProjectionFrame, backProjectionFrame, medianBlurAmount);
-		cv::erode(backProjectionFrame, backProjectionFrame, erosionElement);
-		cv::dilate(backProjectionFrame, backProjectionFrame, dilationElement);
+		backprojection &= mask; // intersection between bpf and mf? This might be useless
+	}
 
+	void CamShift::backProjectPlanes(Scratch& scratch, cv::Mat& backprojection) {
+		PerfCounters::Scope scope(perfCounters, PerfCounters::BACKPROJECT);
+		int planeCount = scratch.hsvPlanes[VAL].empty() ? 2 : CHANNELS;
+		if (lookUpBins || fixedPoint) {
+			backProjectLut(scratch.hsvPlanes, planeCount, backprojection);
+			return;
+		}
+		int sizes[CHANNELS] = { histoFrame.size[HUE], histoFrame.size[SAT], histoFrame.size[VAL] };
+		cv::Mat histogram(planeCount, sizes, CV_32F, histoFrame.data);
+		cv::calcBackProject(scratch.hsvPlanes, planeCount, 
+			channels, 
+			histogram, 
+			backprojection, 
+			getConstantHistoRanges());
+		if (scratch.planesMasked)
+			backprojection &= scratch.maskFrame;
+	}
+
+	void CamShift::filterBackprojection(cv::Mat& frame) {
+		/* A header without a parent, so the filters never read past the frame into the rest of the buffer */
+		cv::Mat backprojection(frame.rows, frame.cols, frame.type(), frame.data, frame.step);
+		double targetSize = std::sqrt((double)track.area());
+		if (adaptiveFilterSize == 0 || targetSize == 0) {
+			applyFilters(backprojection, medianBlurAmount, erosionElement, dilationElement);
+			return;
+		}
+
+		double scale = adaptiveFilterSize / targetSize;
+		if (scale < 1 && !lowMemory) {
+			/* Filtered where the track has the canonical size, so the filters' cost stays constant */
+			Scratch& scratch = getScratch();
+			cv::Size filterSize(std::max(cvRound(frame.cols * scale), 1), std::max(cvRound(frame.rows * scale), 1));
+			resizeView(scratch.filterFrame, filterSize, CV_8UC1);
+			cv::Mat filterFrame(filterSize.height, filterSize.width, CV_8UC1, scratch.filterFrame.data, scratch.filterFrame.step);
+			cv::resize(backprojection, filterFrame, filterSize, 0, 0, cv::INTER_AREA);
+			applyFilters(filterFrame, medianBlurAmount, erosionElement, dilationElement);
+			cv::resize(filterFrame, backprojection, backprojection.size(), 0, 0, cv::INTER_LINEAR);
+			{
+				/* Rethresholded halfway, since interpolation leaves gray edges that the full resolution path never has */
+				PerfCounters::Scope scope(perfCounters, PerfCounters::THRESHOLD);
+				cv::threshold(backprojection, backprojection, 127, 255, cv::THRESH_BINARY);
+			}
+		} else {
+			/* Kernels shrunk with the track, so a small target is not erased; never enlarged past the halo */
+			double shrink = std::min(1 / scale, 1.);
+			int medianRadius = cvRound(medianBlurAmount / 2 * shrink);
+			applyFilters(backprojection, 2 * medianRadius + 1,
+				getDiamondElement(cvRound(erosionElement.rows / 2 * shrink)),
+				getDiamondElement(cvRound(dilationElement.rows / 2 * shrink)));
+		}
+	}
+
+	void CamShift::applyFilters(cv::Mat& backprojection, int medianBlur, const cv::Mat& erosion, const cv::Mat& dilation) {
+		{
+			PerfCounters::Scope scope(perfCounters, PerfCounters::THRESHOLD);
+			cv::threshold(backprojection, backprojection, thresholdAmount, 255, cv::THRESH_BINARY);
+		}
+		if (medianBlur > 1) {
+			PerfCounters::Scope scope(perfCounters, PerfCounters::MEDIAN_BLUR);
+			cv::medianBlur(backprojection, backprojection, medianBlur);
+		}
+		if (!erosion.empty()) {
+			PerfCounters::Scope scope(perfCounters, PerfCounters::ERODE);
+			cv::erode(backprojection, backprojection, erosion);
+		}
+		if (!dilation.empty()) {
+			PerfCounters::Scope scope(perfCounters, PerfCounters::DILATE);
+			cv::dilate(backprojection, backprojection, dilation);
+		}
+	}
+
+	const cv::Mat& CamShift::getDiamondElement(int radius) {
+		/* Radius 0 is left empty, which skips the filter */
+		if ((int)diamondElements.size() <= radius) {
+			int first = (int)diamondElements.size();
+			diamondElements.resize(radius + 1);
+			for (int r = std::max(first, 1); r <= radius; r++) {
+				cv::Mat& diamond = diamondElements[r];
+				diamond = cv::Mat::zeros(2 * r + 1, 2 * r + 1, CV_8UC1);
+				for (int y = -r; y <= r; y++) {
+					for (int x = -r; x <= r; x++)
+						diamond.at<uchar>(y + r, x + r) = std::abs(x) + std::abs(y) <= r;
+				}
+			}
+		}
+		return diamondElements[radius];
+	}
+
+	void CamShift::backProjectStrips() {
+		Scratch& scratch = getScratch();
+		int rows = capturedRawFrame.rows;
+		int cols = capturedRawFrame.cols;
+		
+		/* Each output row depends on the rows within halo of it, through the median blur, erosion and dilation */
+		int halo = medianBlurAmount / 2 + erosionElement.rows / 2 + dilationElement.rows / 2;
+		int stripCapacity = STRIP_ROWS + 2 * halo;
+		resizeView(scratch.hsvStrip, cv::Size(cols, stripCapacity), CV_8UC3);
+		resizeView(scratch.maskStrip, cv::Size(cols, stripCapacity), CV_8UC1);
+		resizeView(scratch.backProjectionStrip, cv::Size(cols, stripCapacity), CV_8UC1);
+
+		for (int first = 0; first < rows; first += STRIP_ROWS) {
+			int last = std::min(first + STRIP_ROWS, rows);
+			int top = std::max(first - halo, 0);
+			int bottom = std::min(last + halo, rows);
+
+			/* Headers without a parent, so the filters never reach past the strip into stale rows */
+			cv::Mat hsv(bottom - top, cols, CV_8UC3, scratch.hsvStrip.data, scratch.hsvStrip.step);
+			cv::Mat mask(bottom - top, cols, CV_8UC1, scratch.maskStrip.data, scratch.maskStrip.step);
+			cv::Mat backprojection(bottom - top, cols, CV_8UC1, scratch.backProjectionStrip.data, scratch.backProjectionStrip.step);
+
+			{
+				PerfCounters::Scope scope(perfCounters, PerfCounters::CONVERT);
+				ColorSpace::convert(colorSpace, capturedRawFrame.rowRange(top, bottom), hsv);
+			}
+			{
+				PerfCounters::Scope scope(perfCounters, PerfCounters::MASK);
+				cv::inRange(hsv, maskRanges[MINI], maskRanges[MAXI], mask);
+			}
+			backProject(hsv, mask, backprojection);
+			filterBackprojection(backprojection);
+			backprojection.rowRange(first - top, last - top).copyTo(backProjectionFrame.rowRange(first, last));
+		}
+	}
+
+	void CamShift::trackBackprojection() {
 		cv::RotatedRect prevTrackRotated = trackRotated;
-		trackRotated = cv::CamShift(backProjectionFrame, track,
-					cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 10, 1));
+		{
+			PerfCounters::Scope scope(perfCounters, PerfCounters::CAMSHIFT);
+			if (ellipseMoments || momentSamples > 0) {
+				/* The previous ellipse belongs to an older selection on the first frame after a selection */
+				cv::RotatedRect region = trackRotated;
+				if (ellipseSelectionCount != selectionCount || region.size.area() <= 0) {
+					region = cv::RotatedRect(
+						cv::Point2f(track.x + track.width / 2.f, track.y + track.height / 2.f),
+						cv::Size2f((float)track.width, (float)track.height), 0);
+				}
+				trackRotated = trackEllipse(region);
+				ellipseSelectionCount = selectionCount;
+			} else {
+				trackRotated = cv::CamShift(backProjectionFrame, track,
+							cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 10, 1));
+			}
+		}
 		if (trackRotated.size.width < WIDTH_MINI) {
 			trackRotated.size.width = WIDTH_MINI;
 		}
@@ -90,6 +812,124 @@ namespace camShift {
 			cv::Rect(0, 0, backProjectionFrame.cols, backProjectionFrame.rows);
 	}
 
+	cv::RotatedRect CamShift::trackEllipse(const cv::RotatedRect& region) {
+		cv::Point2d center = region.center;
+		double semiWidth = region.size.width / 2. + MOMENT_TOLERANCE;
+		double semiHeight = region.size.height / 2. + MOMENT_TOLERANCE;
+		int step = 1;
+		if (momentSamples > 0)
+			step = std::max((int)std::sqrt(CV_PI * semiWidth * semiHeight / momentSamples), 1);
+		double moments[MOMENTS];
+		pixelsVisited = boundingPixels = 0;
+		for (int i = 0; i < MEAN_SHIFT_ITERATIONS; i++) {
+			pixelsVisited += accumulateEllipse(center, semiWidth, semiHeight, region.angle, step, moments);
+			if (moments[M00] <= 0)
+				return cv::RotatedRect();
+			cv::Point2d centroid(moments[M10] / moments[M00], moments[M01] / moments[M00]);
+			cv::Point2d shift = centroid - center;
+			center = centroid;
+			if (shift.x * shift.x + shift.y * shift.y < 1)
+				break; // the moments about the converged center differ by less than a pixel's shift
+		}
+		if (step > 1) {
+			/* One pass over every pixel at the converged center refines the subsampled mean shift */
+			pixelsVisited += accumulateEllipse(center, semiWidth, semiHeight, region.angle, 1, moments);
+			if (moments[M00] <= 0)
+				return cv::RotatedRect();
+		}
+
+		/* The same derivation of the rotated track from the moments as OpenCV's CamShift() */
+		double inverse = 1 / moments[M00];
+		double xc = moments[M10] * inverse;
+		double yc = moments[M01] * inverse;
+		double a = moments[M20] * inverse - xc * xc;
+		double b = moments[M11] * inverse - xc * yc;
+		double c = moments[M02] * inverse - yc * yc;
+		double square = std::sqrt(4 * b * b + (a - c) * (a - c));
+		double theta = std::atan2(2 * b, a - c + square);
+		double cs = std::cos(theta);
+		double sn = std::sin(theta);
+		double rotateA = cs * cs * a + 2 * cs * sn * b + sn * sn * c;
+		double rotateC = sn * sn * a - 2 * cs * sn * b + cs * cs * c;
+		double length = std::sqrt(std::max(rotateA, 0.)) * 4;
+		double width = std::sqrt(std::max(rotateC, 0.)) * 4;
+		if (length < width) {
+			std::swap(length, width);
+			theta = CV_PI / 2 - theta;
+		}
+		float angle = (float)((CV_PI / 2 + theta) * 180 / CV_PI);
+		while (angle < 0)
+			angle += 360;
+		while (angle >= 360)
+			angle -= 360;
+		if (angle >= 180)
+			angle -= 180;
+		return cv::RotatedRect(cv::Point2f((float)xc, (float)yc), cv::Size2f((float)width, (float)length), angle);
+	}
+
+	int64_t CamShift::accumulateEllipse(cv::Point2d center, double semiWidth, double semiHeight, double angle, int step, double* moments) {
+		const cv::Mat& frame = backProjectionFrame;
+		double radians = angle * CV_PI / 180;
+		double cosine = std::cos(radians);
+		double sine = std::sin(radians);
+		double inverseA = 1 / (semiWidth * semiWidth);
+		double inverseB = 1 / (semiHeight * semiHeight);
+
+		/* A point is inside if qxx dx^2 + qxy dx dy + qyy dy^2 <= 1, relative to the center */
+		double qxx = cosine * cosine * inverseA + sine * sine * inverseB;
+		double qxy = 2 * sine * cosine * (inverseA - inverseB);
+		double qyy = sine * sine * inverseA + cosine * cosine * inverseB;
+		double halfWidth = std::sqrt(cosine * cosine / inverseA + sine * sine / inverseB);
+		double halfHeight = std::sqrt(sine * sine / inverseA + cosine * cosine / inverseB);
+		int left = std::max(cvCeil(center.x - halfWidth), 0);
+		int right = std::min(cvFloor(center.x + halfWidth), frame.cols - 1);
+		int top = std::max(cvCeil(center.y - halfHeight), 0);
+		int bottom = std::min(cvFloor(center.y + halfHeight), frame.rows - 1);
+		if (left <= right && top <= bottom)
+			boundingPixels += (int64_t)(right - left + 1) * (bottom - top + 1);
+
+		int64_t m00 = 0, m10 = 0, m01 = 0, m20 = 0, m11 = 0, m02 = 0;
+		int64_t visited = 0;
+		/* The samples lie on a grid aligned to the frame, so they do not shift with the ellipse */
+		for (int y = top + (step - top % step) % step; y <= bottom; y += step) {
+			/* The row's span solves the quadratic in dx */
+			double dy = y - center.y;
+			double linear = qxy * dy;
+			double discriminant = linear * linear - 4 * qxx * (qyy * dy * dy - 1);
+			if (discriminant < 0)
+				continue;
+			double root = std::sqrt(discriminant);
+			int first = std::max(cvCeil(center.x + (-linear - root) / (2 * qxx)), 0);
+			int last = std::min(cvFloor(center.x + (-linear + root) / (2 * qxx)), frame.cols - 1);
+			first += (step - first % step) % step;
+			if (first > last)
+				continue;
+			const uchar* row = frame.ptr<uchar>(y);
+			int64_t s0 = 0, s1 = 0, s2 = 0;
+			for (int x = first; x <= last; x += step) {
+				int weighted = row[x] * x;
+				s0 += row[x];
+				s1 += weighted;
+				s2 += (int64_t)weighted * x;
+			}
+			visited += (last - first) / step + 1;
+			m00 += s0;
+			m10 += s1;
+			m01 += s0 * y;
+			m20 += s2;
+			m11 += s1 * y;
+			m02 += s0 * y * y;
+		}
+		moments[M00] = (double)m00;
+		moments[M10] = (double)m10;
+		moments[M01] = (double)m01;
+		moments[M20] = (double)m20;
+		moments[M11] = (double)m11;
+		moments[M02] = (double)m02;
+		return visited;
+	}
+
+#ifdef CAMSHIFT_EXCEPTIONS
 	cv::Mat& CamShift::getBackprojection() {
 		if (backProjectionFrame.rows == 0 || backProjectionFrame.cols == 0)
 			throw std::runtime_error("Backprojection has not been set");
@@ -103,49 +943,385 @@ namespace camShift {
 	}
 
 	cv::RotatedRect& CamShift::getRotatedTrack() {
-		if (trackRotated.boundingRect().height <= 0 || trackRotated.boundingRect().width <= 0)
+		if (trackRotated.size.width <= 0 || trackRotated.size.height <= 0)
 			throw std::runtime_error("Rotated track has not been set");
 		return trackRotated;
 	}
+#endif
 
-	void CamShift::setHsvFrame() {
-		if (capturedRawFrame.rows == 0 || capturedRawFrame.cols == 0)
-			throw std::runtime_error("Captured raw frame has not been set");
-		cv::cvtColor(capturedRawFrame, hsvFrame, cv::COLOR_BGR2HSV);
-			cv::inRange(hsvFrame, 
+	const CamShift::TrackState& CamShift::getTrackState() {
+		trackStates.acquire();
+		return trackStates.getFront();
+	}
+
+	void CamShift::publishTrackState(bool extrapolated) {
+		TrackState& state = trackStates.getBack();
+		if (lowMemory)
+			state.backprojection.release(); // the one backprojection is rewritten in place by the next frame
+		else
+			state.backprojection = backProjectionFrame;
+		state.extrapolated = extrapolated;
+		state.track = track;
+		state.rotatedTrack = trackRotated;
+		frameTimes.completionTime = LatencyHistogram::now();
+		state.times = frameTimes;
+		trackStates.publish();
+		publishedFrameTimes = frameTimes;
+		runLatency.record(frameTimes.completionTime - frameTimes.startTime);
+		if (frameTimes.captureTime != 0)
+			captureAge.record(frameTimes.completionTime - frameTimes.captureTime);
+	}
+
+	CamShift::Scratch& CamShift::setHsvFrame() {
+		Scratch& scratch = getScratch();
+		resizeView(scratch.hsvFrame, capturedRawFrame.size(), CV_8UC3);
+		resizeView(scratch.maskFrame, capturedRawFrame.size(), CV_8UC1);
+		{
+			PerfCounters::Scope scope(perfCounters, PerfCounters::CONVERT);
+			ColorSpace::convert(colorSpace, capturedRawFrame, scratch.hsvFrame);
+		}
+		{
+			PerfCounters::Scope scope(perfCounters, PerfCounters::MASK);
+			cv::inRange(scratch.hsvFrame, 
 				maskRanges[MINI], 
 				maskRanges[MAXI],
-				maskFrame);
+				scratch.maskFrame);
+		}
+		return scratch;
 	}
 
-	const float** CamShift::getConstantHistoRanges() {
-		static const float* constantHistoRanges[3] = {
-			histoRanges[HUE], 
-			histoRanges[SAT], 
-			histoRanges[VAL]
+	CamShift::Scratch& CamShift::setHsvFrame(const cv::Rect& area) {
+		Scratch& scratch = getScratch();
+		resizeView(scratch.hsvStrip, area.size(), CV_8UC3);
+		resizeView(scratch.maskStrip, area.size(), CV_8UC1);
+		ColorSpace::convert(colorSpace, capturedRawFrame(area), scratch.hsvStrip);
+		cv::inRange(scratch.hsvStrip, maskRanges[MINI], maskRanges[MAXI], scratch.maskStrip);
+		return scratch;
+	}
+
+	CamShift::Scratch& CamShift::setHsvPlanes(int planeCount) {
+		Scratch& scratch = getScratch();
+		for (int i = 0; i < planeCount; i++)
+			resizeView(scratch.hsvPlanes[i], capturedRawFrame.size(), CV_8UC1);
+		if (planeCount < CHANNELS)
+			scratch.hsvPlanes[VAL].release();
+
+		{
+			PerfCounters::Scope scope(perfCounters, PerfCounters::CONVERT);
+			ColorSpace::convertPlanes(colorSpace, capturedRawFrame, scratch.hsvPlanes, planeCount);
+		}
+
+		/* The mask is only produced for planes whose range excludes some values, into buffers kept across frames */
+		PerfCounters::Scope scope(perfCounters, PerfCounters::MASK);
+		scratch.planesMasked = false;
+		for (int i = 0; i < planeCount; i++) {
+			int largest = ColorSpace::getLargest(colorSpace, i); // HSV's 8-bit hue never exceeds 179
+			if (maskRanges[MINI][i] <= 0 && maskRanges[MAXI][i] >= largest)
+				continue;
+			cv::Mat& planeMask = scratch.planesMasked ? scratch.planeMask : scratch.maskFrame;
+			resizeView(planeMask, capturedRawFrame.size(), CV_8UC1);
+			cv::inRange(scratch.hsvPlanes[i], cv::Scalar(maskRanges[MINI][i]), cv::Scalar(maskRanges[MAXI][i]), planeMask);
+			if (scratch.planesMasked)
+				cv::bitwise_and(scratch.maskFrame, scratch.planeMask, scratch.maskFrame);
+			scratch.planesMasked = true;
+		}
+		return scratch;
+	}
+
+	int CamShift::getPlaneCount(int valueBins) {
+		bool valueMasked = maskRanges[MINI][VAL] > 0 || maskRanges[MAXI][VAL] < UCHAR_MAX;
+		return valueBins > 1 || valueMasked ? CHANNELS : 2;
+	}
+
+	CamShift::Scratch& CamShift::getScratch() {
+		if (!sharedScratch)
+			return ownScratch;
+		static thread_local Scratch threadScratch; // shared by every tracker the thread runs
+		return threadScratch;
+	}
+
+	size_t CamShift::getMemoryUsage() {
+		const cv::Mat* buffers[] = { 
+			&ownScratch.hsvFrame, 
+			&ownScratch.maskFrame, 
+			&ownScratch.hsvStrip,
+			&ownScratch.maskStrip,
+			&ownScratch.backProjectionStrip,
+			&ownScratch.hsvPlanes[HUE],
+			&ownScratch.hsvPlanes[SAT],
+			&ownScratch.hsvPlanes[VAL],
+			&ownScratch.planeMask,
+			&ownScratch.filterFrame,
+			&histoFrame,
+			&selectedHistoFrame,
+			&stripsBackprojection,
+			&trackStates.peek(0).backprojection,
+			&trackStates.peek(1).backprojection,
+			&trackStates.peek(2).backprojection
 		};
+		std::vector<const cv::Mat*> frames(buffers, buffers + sizeof(buffers) / sizeof(buffers[0]));
+		for (size_t i = 0; i < spareBackprojections.size(); i++)
+			frames.push_back(&spareBackprojections[i]);
+		size_t bytes = 0;
+		for (size_t i = 0; i < frames.size(); i++) {
+			if (frames[i]->empty())
+				continue;
+			if (frames[i]->dims > 2) {
+				bytes += frames[i]->total() * frames[i]->elemSize();
+				continue;
+			}
+			size_t j = 0;
+			while (j < i && frames[j]->datastart != frames[i]->datastart)
+				j++;
+			if (j < i)
+				continue; // an extrapolated state shares an earlier backprojection
+			cv::Size whole;
+			cv::Point offset;
+			frames[i]->locateROI(whole, offset); // count the whole buffer, not just the current view
+			bytes += whole.area() * frames[i]->elemSize();
+		}
+		return bytes;
+	}
+
+	void CamShift::resizeView(cv::Mat& frame, cv::Size size, int type) {
+		if (!frame.empty() && frame.type() == type) {
+			cv::Size whole;
+			cv::Point offset;
+			frame.locateROI(whole, offset);
+			if (whole.width >= size.width && whole.height >= size.height) {
+				frame.adjustROI(0, whole.height - frame.rows, 0, whole.width - frame.cols);
+				frame = frame(cv::Rect(0, 0, size.width, size.height));
+				return;
+			}
+		}
+		frame.create(size, type);
+	}
+
+	const float** CamShift::getConstantHistoRanges() {
 		return constantHistoRanges;
 	}
 
+	void CamShift::setBinTables() {
+		binCount = buildBinTables(binTables);
+	}
+
+	int CamShift::buildBinTables(int (*tables)[256]) const {
+		/*
+		 * Maps each channel value to its part of the flat bin index, in the same way as calcHist() and 
+		 * calcBackProject(). Values outside the histogram's range or the mask's range map to OUT_OF_RANGE,
+		 * so such pixels are neither counted nor backprojected, just as if the mask had cleared them.
+		 * The bins were checked by areBinsValid(), so every index lies below OUT_OF_RANGE.
+		 */
+		size_t binStride = 1;
+		for (int c = CHANNELS - 1; c >= 0; c--) {
+			int bins = histoBins[c];
+			double scale = bins / ((double)histoRanges[c][MAXI] - histoRanges[c][MINI]);
+			double offset = -scale * histoRanges[c][MINI];
+			for (int v = 0; v < 256; v++) {
+				bool inHisto = v >= cvCeil(histoRanges[c][MINI]) && v < cvCeil(histoRanges[c][MAXI]);
+				bool inMask = v >= maskRanges[MINI][c] && v <= maskRanges[MAXI][c];
+				int bin = std::max(std::min(cvFloor(v * scale + offset), bins - 1), 0);
+				tables[c][v] = inHisto && inMask ? (int)(bin * binStride) : OUT_OF_RANGE;
+			}
+			binStride *= bins;
+		}
+		return (int)binStride;
+	}
+
+	bool CamShift::areBinsValid(const int* bins) {
+		size_t binTotal = 1;
+		for (int c = 0; c < CHANNELS; c++) {
+			if (bins[c] <= 0 || bins[c] > BINS_MAXI)
+				return false;
+			binTotal *= bins[c];
+		}
+		return binTotal <= (size_t)OUT_OF_RANGE; // every flat index must lie below OUT_OF_RANGE
+	}
+
+	void CamShift::setBinWeights() {
+		/* An extra zero weight at the end, so out of range pixels are looked up without a branch */
+		binWeights.resize(binCount + 1);
+		const float* histo = histoFrame.ptr<float>();
+		float scale = 1;
+		if (fixedPoint) {
+			float largest = *std::max_element(histo, histo + binCount);
+			scale = largest > 0 ? UCHAR_MAX / largest : 0;
+		}
+		for (int bin = 0; bin < binCount; bin++)
+			binWeights[bin] = cv::saturate_cast<uchar>(histo[bin] * scale);
+		binWeights[binCount] = 0;
+		weightsCount++;
+	}
+
+	void CamShift::getRowChannels(const cv::Mat* frames, int frameCount, int y, const uchar** rows, int* steps) {
+		static const uchar zero = 0; // stands in for a value plane that was never produced
+		for (int c = 0; c < CHANNELS; c++) {
+			if (frameCount == 1) {
+				rows[c] = frames[0].ptr<uchar>(y) + c;
+				steps[c] = CHANNELS;
+			} else if (c < frameCount) {
+				rows[c] = frames[c].ptr<uchar>(y);
+				steps[c] = 1;
+			} else {
+				rows[c] = &zero;
+				steps[c] = 0;
+			}
+		}
+	}
+
+	/* Counts one band of rows of the selection per index of the range, each into its own sub-histograms */
+	class CamShift::HistogramBands : public cv::ParallelLoopBody {
+	public:
+		HistogramBands(const cv::Mat* frames, int frameCount, const int (*tables)[256], int count, int bands, int subHistograms, int* counts) :
+				frames(frames),
+				frameCount(frameCount),
+				tables(tables),
+				count(count),
+				bands(bands),
+				subHistograms(subHistograms),
+				counts(counts) { }
+
+		void operator()(const cv::Range& range) const {
+			int rows = frames[0].rows;
+			int stride = count + 1;
+			int subStride = subHistograms > 1 ? stride : 0;
+			for (int band = range.start; band < range.end; band++) {
+				countBins(frames, frameCount, tables, count, rows * band / bands, rows * (band + 1) / bands, 
+					counts + band * subHistograms * stride, subStride);
+			}
+		}
+
+	private:
+		const cv::Mat* frames;
+		int frameCount;
+		const int (*tables)[256];
+		int count;
+		int bands;
+		int subHistograms;
+		int* counts;
+	};
+
+	void CamShift::calcHistLut(const cv::Mat* frames, int frameCount, const int (*tables)[256], int count, cv::Mat& histogram) {
+		/* Every count is zeroed and summed, so each must stand for a few pixels, or the bands cost more than they save */
+		int stride = count + 1;
+		size_t pixels = frames[0].total();
+		int subHistograms = pixels >= (size_t)PIXELS_PER_COUNT * SUB_HISTOGRAMS * stride ? SUB_HISTOGRAMS : 1;
+		int bands = 1;
+		if (pixels >= PARALLEL_HISTOGRAM_PIXELS) {
+			size_t countable = pixels / ((size_t)PIXELS_PER_COUNT * subHistograms * stride);
+			bands = (int)std::min((size_t)std::min(cv::getNumThreads(), frames[0].rows), countable);
+			bands = std::max(bands, 1);
+		}
+		std::vector<int>& counts = getScratch().binCounts;
+		counts.assign(bands * subHistograms * stride, 0); // keeps its capacity from earlier selections
+		if (bands == 1)
+			countBins(frames, frameCount, tables, count, 0, frames[0].rows, &counts[0], subHistograms > 1 ? stride : 0);
+		else
+			cv::parallel_for_(cv::Range(0, bands), HistogramBands(frames, frameCount, tables, count, bands, subHistograms, &counts[0]));
+
+		histogram.create(CHANNELS, histoBins, CV_32F);
+		float* histo = histogram.ptr<float>();
+		for (int bin = 0; bin < count; bin++) {
+			int sum = 0;
+			for (int i = 0; i < bands * subHistograms; i++)
+				sum += counts[i * stride + bin];
+			histo[bin] = (float)sum;
+		}
+	}
+
+	void CamShift::countBins(const cv::Mat* frames, int frameCount, const int (*tables)[256], int count, int firstRow, int lastRow, int* counts, int subStride) {
+		/* Neighbouring pixels usually share a bin, so each of four in a row increments its own sub-histogram */
+		int* counts0 = counts;
+		int* counts1 = counts + subStride;
+		int* counts2 = counts + 2 * subStride;
+		int* counts3 = counts + 3 * subStride;
+		const int* hueTable = tables[HUE];
+		const int* satTable = tables[SAT];
+		const int* valTable = tables[VAL];
+		const uchar* rows[CHANNELS];
+		int steps[CHANNELS];
+		int cols = frames[0].cols;
+		for (int y = firstRow; y < lastRow; y++) {
+			getRowChannels(frames, frameCount, y, rows, steps);
+			const uchar* hues = rows[HUE];
+			const uchar* sats = rows[SAT];
+			const uchar* vals = rows[VAL];
+			int hueStep = steps[HUE];
+			int satStep = steps[SAT];
+			int valStep = steps[VAL];
+			int x = 0;
+			for (; x + SUB_HISTOGRAMS <= cols; x += SUB_HISTOGRAMS) {
+				int bin0 = hueTable[hues[0]] + satTable[sats[0]] + valTable[vals[0]];
+				int bin1 = hueTable[hues[hueStep]] + satTable[sats[satStep]] + valTable[vals[valStep]];
+				int bin2 = hueTable[hues[2 * hueStep]] + satTable[sats[2 * satStep]] + valTable[vals[2 * valStep]];
+				int bin3 = hueTable[hues[3 * hueStep]] + satTable[sats[3 * satStep]] + valTable[vals[3 * valStep]];
+				counts0[std::min(bin0, count)]++;
+				counts1[std::min(bin1, count)]++;
+				counts2[std::min(bin2, count)]++;
+				counts3[std::min(bin3, count)]++;
+				hues += SUB_HISTOGRAMS * hueStep;
+				sats += SUB_HISTOGRAMS * satStep;
+				vals += SUB_HISTOGRAMS * valStep;
+			}
+			for (; x < cols; x++) {
+				counts0[std::min(hueTable[*hues] + satTable[*sats] + valTable[*vals], count)]++;
+				hues += hueStep;
+				sats += satStep;
+				vals += valStep;
+			}
+		}
+	}
+
+	void CamShift::backProjectLut(const cv::Mat* frames, int frameCount, cv::Mat& backprojection) {
+		const uchar* weights = &binWeights[0];
+		const uchar* rows[CHANNELS];
+		int steps[CHANNELS];
+		for (int y = 0; y < frames[0].rows; y++) {
+			getRowChannels(frames, frameCount, y, rows, steps);
+			const uchar* hues = rows[HUE];
+			const uchar* sats = rows[SAT];
+			const uchar* vals = rows[VAL];
+			uchar* output = backprojection.ptr<uchar>(y);
+			for (int x = 0; x < frames[0].cols; x++) {
+				int bin = binTables[HUE][*hues] + binTables[SAT][*sats] + binTables[VAL][*vals];
+				output[x] = weights[std::min(bin, binCount)];
+				hues += steps[HUE];
+				sats += steps[SAT];
+				vals += steps[VAL];
+			}
+		}
+	}
+
+#ifdef CAMSHIFT_EXCEPTIONS
 	void CamShift::setParameter(Parameter parameter, long newParameter) {
-		char* errorMessage = NULL;
-		char greaterThanZero[] = "parameter must be greater than or equal to 0";
+		const char* errorMessage = changeParameter(parameter, newParameter);
+		if (errorMessage != NULL)
+			throw std::runtime_error(errorMessage);
+	}
+#endif
+
+	CamShift::Status CamShift::trySetParameter(Parameter parameter, long newParameter) noexcept {
+		const char* errorMessage = NULL;
+		Status status = guard([&]() { errorMessage = changeParameter(parameter, newParameter); });
+		return status == OK && errorMessage != NULL ? INVALID_PARAMETER : status;
+	}
+
+	const char* CamShift::changeParameter(Parameter parameter, long newParameter) {
+		const char* errorMessage = NULL;
+		const char* greaterThanZero = "parameter must be greater than or equal to 0";
+		const char* binsRange = "parameter must be from 1 to 256";
 		switch (parameter) {
 		case HUE_BINS_C:
-			if (newParameter >= 0) {
-				histoBins[HUE] = newParameter;
-			} else { errorMessage = greaterThanZero; }
-			break;
 		case SAT_BINS_C:
-			if (newParameter >= 0) {
-				histoBins[SAT] = newParameter;
-			} else { errorMessage = greaterThanZero; }
-			break;
-		case VAL_BINS_C:
-			if (newParameter >= 0) {
-				histoBins[VAL] = newParameter;
-			} else { errorMessage = greaterThanZero; }
+		case VAL_BINS_C: {
+			int channel = parameter - HUE_BINS_C;
+			int bins[CHANNELS] = { histoBins[HUE], histoBins[SAT], histoBins[VAL] };
+			bins[channel] = (int)std::max(std::min(newParameter, (long)INT_MAX), 0L);
+			if (areBinsValid(bins)) {
+				histoBins[channel] = bins[channel];
+			} else { errorMessage = binsRange; }
 			break;
+		}
 		case MEDIAN_BLUR_C:
 			if (newParameter > 1 && (long)newParameter % 2 == 1) {
 				medianBlurAmount = newParameter;
@@ -156,9 +1332,106 @@ namespace camShift {
 				thresholdAmount = newParameter;
 			} else { errorMessage = "parameter must be greater than or equal to 0, and less than or equal to 255"; }
 			break;
+		case SHARED_SCRATCH_C:
+			if (newParameter == 0 || newParameter == 1) {
+				sharedScratch = newParameter == 1;
+				if (sharedScratch)
+					ownScratch = Scratch();
+			} else { errorMessage = "parameter must be 0 or 1"; }
+			break;
+		case LOW_MEMORY_C:
+			if (newParameter == 0 || newParameter == 1) {
+				lowMemory = newParameter == 1;
+				Scratch& scratch = getScratch();
+				if (lowMemory) {
+					scratch.hsvFrame.release();
+					scratch.maskFrame.release();
+					spareBackprojections.clear(); // the published backprojections are released as their slots are reused
+				} else {
+					scratch.hsvStrip.release();
+					scratch.maskStrip.release();
+					scratch.backProjectionStrip.release();
+					stripsBackprojection.release();
+				}
+			} else { errorMessage = "parameter must be 0 or 1"; }
+			break;
+		case PLANAR_HSV_C:
+			if (newParameter == 0 || newParameter == 1) {
+				planarHsv = newParameter == 1;
+				Scratch& scratch = getScratch();
+				if (planarHsv) {
+					scratch.hsvFrame.release();
+				} else {
+					for (int i = 0; i < CHANNELS; i++)
+						scratch.hsvPlanes[i].release();
+					scratch.planeMask.release();
+					scratch.planesMasked = false;
+				}
+				scratch.maskFrame.release();
+			} else { errorMessage = "parameter must be 0 or 1"; }
+			break;
+		case LOOK_UP_BINS_C:
+			if (newParameter == 0 || newParameter == 1) {
+				lookUpBins = newParameter == 1;
+			} else { errorMessage = "parameter must be 0 or 1"; }
+			break;
+		case FIXED_POINT_C:
+			if (newParameter == 0 || newParameter == 1) {
+				fixedPoint = newParameter == 1;
+				if (!histoFrame.empty())
+					setBinWeights();
+			} else { errorMessage = "parameter must be 0 or 1"; }
+			break;
+		case PERF_COUNTERS_C:
+			if (newParameter == 0 || newParameter == 1) {
+				perfCounters.setEnabled(newParameter == 1);
+			} else { errorMessage = "parameter must be 0 or 1"; }
+			break;
+		case ADAPTIVE_FILTER_C:
+			if (newParameter == 0 || newParameter >= 8) {
+				adaptiveFilterSize = newParameter;
+				if (adaptiveFilterSize == 0)
+					getScratch().filterFrame.release();
+			} else { errorMessage = "parameter must be 0, or greater than or equal to 8"; }
+			break;
+		case ELLIPSE_MOMENTS_C:
+			if (newParameter == 0 || newParameter == 1) {
+				ellipseMoments = newParameter == 1;
+				pixelsVisited = boundingPixels = 0;
+			} else { errorMessage = "parameter must be 0 or 1"; }
+			break;
+		case MOMENT_SAMPLES_C:
+			if (newParameter == 0 || newParameter >= 256) {
+				momentSamples = newParameter;
+			} else { errorMessage = "parameter must be 0, or greater than or equal to 256"; }
+			break;
+		case DUTY_CYCLE_C:
+			if (newParameter == 0 || newParameter >= 2) {
+				dutyCycle = newParameter;
+				dutySelectionCount = -1;
+				framesProcessed = framesExtrapolated = processingTime = extrapolationTime = 0;
+			} else { errorMessage = "parameter must be 0, or greater than or equal to 2"; }
+			break;
+		case BACKGROUND_RING_C:
+			if (newParameter >= 0) {
+				backgroundRing = newParameter;
+			} else { errorMessage = greaterThanZero; }
+			break;
+		case COLOR_SPACE_C:
+			if (newParameter >= 0 && newParameter < ColorSpace::SPACES) {
+				if (newParameter != colorSpace) {
+					colorSpace = (ColorSpace::Space)newParameter;
+					histoRanges[HUE][MAXI] = ColorSpace::getLargest(colorSpace, HUE) + 1;
+					maskRanges[MAXI] = cv::Scalar(histoRanges[HUE][MAXI], SAT_MAX, VAL_MAX);
+					histoFrame.release();
+				}
+			} else { errorMessage = "parameter must be a ColorSpace::Space"; }
+			break;
+		default:
+			errorMessage = "unknown parameter";
+			break;
 		}
-		if (errorMessage != NULL)
-			throw std::runtime_error(errorMessage);
+		return errorMessage;
 	}
 
 	long CamShift::getParameter(Parameter parameter) {
@@ -168,7 +1441,68 @@ namespace camShift {
 		case VAL_BINS_C:	return histoBins[VAL];
 		case MEDIAN_BLUR_C: return medianBlurAmount;
 		case THRESHOLD_C:	return thresholdAmount;
+		case SHARED_SCRATCH_C: return sharedScratch;
+		case LOW_MEMORY_C:	return lowMemory;
+		case PLANAR_HSV_C:	return planarHsv;
+		case LOOK_UP_BINS_C: return lookUpBins;
+		case FIXED_POINT_C:	return fixedPoint;
+		case PERF_COUNTERS_C: return perfCounters.isEnabled();
+		case ADAPTIVE_FILTER_C: return adaptiveFilterSize;
+		case ELLIPSE_MOMENTS_C: return ellipseMoments;
+		case MOMENT_SAMPLES_C: return momentSamples;
+		case DUTY_CYCLE_C:	return dutyCycle;
+		case BACKGROUND_RING_C: return backgroundRing;
+		case COLOR_SPACE_C:	return colorSpace;
 		default: return 0;
 		}
 	}
+
+	const char* CamShift::getStatusMessage(Status status) noexcept {
+		switch (status) {
+		case OK:					return "OK";
+		case FRAME_NOT_SET:			return "Captured raw frame has not been set";
+		case SELECTION_NOT_SET:		return "Selection has not been set";
+		case INVALID_SELECTION:		return "Invalid selection";
+		case INVALID_FRAME_SIZE:	return "Invalid frame size";
+		case INVALID_PIXEL_FORMAT:	return "Pixel format must be CV_8UC3";
+		case INVALID_PARAMETER:		return "Invalid parameter";
+		case OPENCV_FAILED:			return "OpenCV failed";
+		case NO_TARGETS:			return "No CamShift objects have been added";
+		case INCOMPATIBLE_HISTOGRAMS:	return "Histograms must have the same bins and color space";
+		case UNSUPPORTED_PARAMETER:	return "MultiCamShift does not support LOW_MEMORY_C or PLANAR_HSV_C";
+		default:					return "Unknown status";
+		}
+	}
+
+	CamShift::Status CamShift::checkFrame() const noexcept {
+		if (capturedRawFrame.rows == 0 || capturedRawFrame.cols == 0)
+			return FRAME_NOT_SET;
+		if (histoFrame.empty())
+			return SELECTION_NOT_SET;
+		return OK;
+	}
+
+	CamShift::Status CamShift::checkSelection(const cv::Rect& selection) const noexcept {
+		if (capturedRawFrame.rows == 0 || capturedRawFrame.cols == 0)
+			return FRAME_NOT_SET;
+		if (selection.width <= 0 || selection.height <= 0 || selection.x < 0 || selection.y < 0 ||
+				selection.x + selection.width > capturedRawFrame.cols || selection.y + selection.height > capturedRawFrame.rows)
+			return INVALID_SELECTION;
+		return OK;
+	}
+
+	CamShift::Status CamShift::checkFormat(cv::Size frameSize, int pixelFormat) noexcept {
+		if (pixelFormat != CV_8UC3)
+			return INVALID_PIXEL_FORMAT;
+		if (frameSize.width <= 0 || frameSize.height <= 0)
+			return INVALID_FRAME_SIZE;
+		return OK;
+	}
+
+#ifdef CAMSHIFT_EXCEPTIONS
+	void CamShift::throwStatus(Status status) {
+		if (status != OK)
+			throw std::runtime_error(getStatusMessage(status));
+	}
+#endif
 };
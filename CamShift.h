@@ -8,7 +8,16 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <exception>
+#include <vector>
+#include "TripleBuffer.h"
+#include "LatencyHistogram.h"
+#include "PerfCounters.h"
+#include "ColorSpace.h"
 
+/* The throwing API is only declared when the compiler has exceptions enabled, as it does by default */
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define CAMSHIFT_EXCEPTIONS
+#endif
 
 /**
  * \brief Contains the CamShift class
@@ -17,6 +26,9 @@
  */
 namespace camShift {
 
+	class MultiCamShift;
+	class DebugRecorder;
+
 	/**
 	 * \brief Carries out the CAMShift algorithm, utilizing OpenCV libraries
 	 *
@@ -40,6 +52,11 @@ namespace camShift {
 	 * several filtration methods so as to optimize the results of the algorithm. Please keep in mind the
 	 * the CamShift generates backprojections highly based on the color of the desired object.
 	 *
+	 * runCamShift(), setSelection(), setParameter() and prepare() have noexcept counterparts, such as
+	 * tryRunCamShift(), which return a Status instead of throwing. When compiled without exceptions, as
+	 * with -fno-exceptions, only the noexcept counterparts are declared, the results are read from 
+	 * tryRunCamShift() or getTrackState() rather than the throwing getters, and checkpoints are unavailable.
+	 *
 	 * \see <a href="http://docs.opencv.org/trunk/doc/py_tutorials/py_video/py_meanshift/py_meanshift.html">Meanshift and Camshift</a>
 	 * \author Andrew Powell
 	 * \date June 14th, 2014
@@ -47,11 +64,100 @@ namespace camShift {
 	class CamShift {
 	public:
 
-		/** \brief Largest Threshold value */
-		enum { THRESHOLD_MAXI = 255 };
+		/** \brief Largest Threshold value, and largest number of bins per channel, one per 8-bit value */
+		enum { THRESHOLD_MAXI = 255, BINS_MAXI = 256 };
+
+		/**
+		 * \brief An enumerator type used to specify a parameter to change and view with the setParameter() and
+		 * getParameter() methods, respectively. PARAMETERS is the number of parameters rather than one of them
+		 */
+		enum Parameter { HUE_BINS_C, SAT_BINS_C, VAL_BINS_C, MEDIAN_BLUR_C, THRESHOLD_C, SHARED_SCRATCH_C, LOW_MEMORY_C, PLANAR_HSV_C, LOOK_UP_BINS_C, FIXED_POINT_C, PERF_COUNTERS_C, ADAPTIVE_FILTER_C, ELLIPSE_MOMENTS_C, MOMENT_SAMPLES_C, DUTY_CYCLE_C, BACKGROUND_RING_C, COLOR_SPACE_C, PARAMETERS };
+
+		/**
+		 * \brief Identifies the frame a result was calculated from, and when it was calculated
+		 *
+		 * All times are in nanoseconds of the monotonic clock read by LatencyHistogram::now(). The time a 
+		 * frame spent queued before processing is startTime - captureTime, the time spent processing it is
+		 * completionTime - startTime, and a result is stale once LatencyHistogram::now() - captureTime 
+		 * exceeds what the application tolerates.
+		 */
+		struct FrameTimes {
+			/** \brief The frame's sequence number */
+			int64_t sequence;
+			/** \brief The time at which the frame was captured, or 0 if unknown */
+			int64_t captureTime;
+			/** \brief The time at which runCamShift() started processing the frame */
+			int64_t startTime;
+			/** \brief The time at which runCamShift() published the frame's results */
+			int64_t completionTime;
+		};
 
-		/** \brief An enumerator type used to specify a parameter to change and view with the setParameter() and getParameter() methods, respectively */
-		enum Parameter { HUE_BINS_C, SAT_BINS_C, VAL_BINS_C, MEDIAN_BLUR_C, THRESHOLD_C };
+		/**
+		 * \brief The results of one call to runCamShift()
+		 *
+		 * A TrackState is published at the end of every runCamShift(), and is never modified while a 
+		 * reader holds it. See getTrackState().
+		 */
+		struct TrackState {
+			/**
+			 * \brief The backprojection from which the track was calculated, shared with earlier states while
+			 * extrapolated, or empty when LOW_MEMORY_C is set
+			 */
+			cv::Mat backprojection;
+			/** \brief The track window, which is the rotated track's bounding rectangle */
+			cv::Rect track;
+			/** \brief The rotated track window */
+			cv::RotatedRect rotatedTrack;
+			/** \brief The frame the results were calculated from, and when */
+			FrameTimes times;
+			/** \brief Whether the track was extrapolated rather than calculated. See DUTY_CYCLE_C */
+			bool extrapolated;
+		};
+
+		/**
+		 * \brief The outcome of a call to the noexcept API
+		 *
+		 * Each value other than OK corresponds to a runtime_error thrown by the throwing API, and 
+		 * getStatusMessage() gives the same message.
+		 */
+		enum Status { 
+			/** \brief The call succeeded */
+			OK, 
+			/** \brief The captured raw frame has not been set */
+			FRAME_NOT_SET, 
+			/** \brief The selection has not been set, so there is no histogram to backproject */
+			SELECTION_NOT_SET, 
+			/** \brief The selection is empty or extends outside the captured raw frame */
+			INVALID_SELECTION, 
+			/** \brief The frame size given to tryPrepare() is empty */
+			INVALID_FRAME_SIZE, 
+			/** \brief The pixel format given to tryPrepare() is not CV_8UC3 */
+			INVALID_PIXEL_FORMAT, 
+			/** \brief The parameter is unknown, or the value is out of its range */
+			INVALID_PARAMETER, 
+			/** \brief OpenCV raised an error, such as failing to allocate a buffer */
+			OPENCV_FAILED, 
+			/** \brief No CamShift object has been added to the MultiCamShift object */
+			NO_TARGETS, 
+			/** \brief The MultiCamShift object's histograms differ in their bins or color spaces */
+			INCOMPATIBLE_HISTOGRAMS, 
+			/** \brief A CamShift object of the MultiCamShift object has LOW_MEMORY_C or PLANAR_HSV_C set */
+			UNSUPPORTED_PARAMETER 
+		};
+
+		/**
+		 * \brief The results of one call to tryRunCamShift(), copied out so that no getter is needed
+		 */
+		struct TrackResult {
+			/** \brief The track window, which is the rotated track's bounding rectangle */
+			cv::Rect track;
+			/** \brief The rotated track window */
+			cv::RotatedRect rotatedTrack;
+			/** \brief The frame the results were calculated from, and when */
+			FrameTimes times;
+			/** \brief Whether the track was extrapolated rather than calculated. See DUTY_CYCLE_C */
+			bool extrapolated;
+		};
 		
 		/** \brief Constructor */
 		CamShift();
@@ -66,11 +172,42 @@ namespace camShift {
 		 * class is being employed to determine the location of an object in real-time, the captured raw frame
 		 * should be set to every new frame.
 		 *
+		 * If the captured raw frame's size differs from the previous one's, as when a camera switches
+		 * resolution, the track and rotated track are rescaled into the new frame's coordinates so that
+		 * tracking continues without a new selection. 
+		 *
 		 * \param capturedRawFrame A reference to the image over which the CAMShift algorithm is executed
 		 * \warning setCapturedRawFrame() should be called prior to calling setSelection() and runCamShift().
 		 */
 		void setCapturedRawFrame(cv::Mat& capturedRawFrame);
 
+		/**
+		 * \brief Sets the captured raw frame along with the time at which it was captured
+		 *
+		 * The capture time allows runCamShift() to record how old each frame is once its results are 
+		 * published. See getCaptureAge().
+		 *
+		 * \param capturedRawFrame A reference to the image over which the CAMShift algorithm is executed
+		 * \param captureTime The time at which the frame was captured, from LatencyHistogram::now(), or 0 
+		 * if unknown
+		 */
+		void setCapturedRawFrame(cv::Mat& capturedRawFrame, int64_t captureTime);
+
+		/**
+		 * \brief Sets the captured raw frame along with its sequence number and capture time
+		 *
+		 * The sequence number and capture time are carried through runCamShift() into the frame's results,
+		 * so that each result can be tied back to its frame. See getFrameTimes() and getTrackState(). If no
+		 * sequence number is given, each captured raw frame is numbered one after the previous one.
+		 *
+		 * \param capturedRawFrame A reference to the image over which the CAMShift algorithm is executed
+		 * \param captureTime The time at which the frame was captured, from LatencyHistogram::now(), or 0 
+		 * if unknown
+		 * \param sequence The frame's sequence number, such as the camera's frame counter
+		 */
+		void setCapturedRawFrame(cv::Mat& capturedRawFrame, int64_t captureTime, int64_t sequence);
+
+#ifdef CAMSHIFT_EXCEPTIONS
 		/**
 		 * \brief Sets the selection window
 		 *
@@ -84,19 +221,222 @@ namespace camShift {
 		 * the captured raw frame has not been set.
 		 */
 		void setSelection(cv::Rect& selection);
+#endif
+
+		/**
+		 * \brief Sets the selection window without throwing
+		 * \param selection A reference to the rectangle that acts as the new window
+		 * \return Returns OK, FRAME_NOT_SET, INVALID_SELECTION if the selection is empty or extends outside
+		 * the captured raw frame, or OPENCV_FAILED
+		 * \see setSelection()
+		 */
+		Status trySetSelection(const cv::Rect& selection) noexcept;
 
+#ifdef CAMSHIFT_EXCEPTIONS
 		/** 
 		 * \brief Executes the CAMShift algorithm and other operations intended to optimize the results
 		 *
 		 * For every new captured raw frame, the runCamShift() should be called in order to determine a new
 		 * window. 
 		 *
-		 * \throw runtime_error The runtime error is thrown if the captured raw frame has not been set.
+		 * \throw runtime_error The runtime error is thrown if the captured raw frame or the selection has not
+		 * been set. See tryRunCamShift().
 		 * \warning The methods setSelection() and setCapturedRawFrame() should be called at least once prior
 		 * to calling runCamShift().
 		 */
 		void runCamShift();
+#endif
+
+		/**
+		 * \brief Executes the CAMShift algorithm without throwing, and copies out the results
+		 *
+		 * tryRunCamShift() is the per-frame call of the noexcept API, for builds without exceptions and for
+		 * callers that would rather not pay for them on every frame. The captured raw frame and selection 
+		 * are validated once, up front, and the pipeline then runs without further checks. runCamShift() 
+		 * is a thin wrapper that throws the same failures. Errors raised inside OpenCV are returned as
+		 * OPENCV_FAILED when exceptions are enabled, and end the program otherwise.
+		 *
+		 * \param result A reference to the structure that receives the track, the rotated track and the
+		 * frame times, left unchanged unless OK is returned
+		 * \return Returns OK, FRAME_NOT_SET, SELECTION_NOT_SET or OPENCV_FAILED
+		 */
+		Status tryRunCamShift(TrackResult& result) noexcept;
 
+#ifdef CAMSHIFT_EXCEPTIONS
+		/**
+		 * \brief Allocates every buffer ahead of the first frame
+		 *
+		 * Without prepare(), the buffers are allocated lazily and OpenCV initializes its internals during 
+		 * the first setSelection() and runCamShift(), which makes the first frame much slower than the 
+		 * rest. prepare() allocates and touches every buffer for the given frame size, and runs one dummy 
+		 * pass of the pipeline with the current parameters. The selection, track and captured raw frame 
+		 * are left as they were, and nothing is published.
+		 *
+		 * Every frame-sized buffer is used as a view into storage that only ever grows. If the frame size
+		 * changes at runtime, prepare() should be given the largest frame size, so that smaller frames 
+		 * reuse the same storage and switching resolution causes no allocations.
+		 *
+		 * \param frameSize The size of the frames that will be passed to setCapturedRawFrame()
+		 * \param pixelFormat The type of the frames that will be passed to setCapturedRawFrame(), which
+		 * must be CV_8UC3
+		 * \throw runtime_error A runtime error is thrown if the frame size or pixel format is invalid.
+		 * \warning prepare() should be called after setParameter() and before getTrackState() is first
+		 * called by a reader thread.
+		 */
+		void prepare(cv::Size frameSize, int pixelFormat);
+#endif
+
+		/**
+		 * \brief Allocates every buffer ahead of the first frame without throwing
+		 * \param frameSize The size of the frames that will be passed to setCapturedRawFrame()
+		 * \param pixelFormat The type of the frames that will be passed to setCapturedRawFrame()
+		 * \return Returns OK, INVALID_FRAME_SIZE, INVALID_PIXEL_FORMAT or OPENCV_FAILED
+		 * \see prepare()
+		 */
+		Status tryPrepare(cv::Size frameSize, int pixelFormat) noexcept;
+
+		/**
+		 * \brief Gets the size of the checkpoint that serialize() would write
+		 * \return Returns the size of the checkpoint in bytes
+		 */
+		size_t getSerializedSize();
+
+#ifdef CAMSHIFT_EXCEPTIONS
+		/**
+		 * \brief Writes a checkpoint of the tracker's state
+		 *
+		 * The checkpoint holds every parameter, the histogram of the selection, the track, the rotated 
+		 * track, the size of the latest captured raw frame and the latest frame's sequence number, in the 
+		 * machine's native byte order. With the default parameters, it is about a kilobyte. Another CamShift
+		 * object, such as a standby tracker in another process, can then restore() the checkpoint and
+		 * continue tracking from the next captured raw frame without a new selection. The captured raw frame
+		 * itself is not part of the checkpoint.
+		 *
+		 * \param checkpoint A pointer to the buffer that receives the checkpoint, such as shared memory
+		 * \param size The size of the buffer in bytes
+		 * \return Returns the size of the checkpoint in bytes
+		 * \throw runtime_error A runtime error is thrown if the buffer is smaller than getSerializedSize().
+		 */
+		size_t serialize(uchar* checkpoint, size_t size);
+
+		/**
+		 * \brief Writes a checkpoint of the tracker's state into a vector
+		 * \param checkpoint A reference to the vector that receives the checkpoint, which is resized to fit
+		 * \see serialize(uchar*, size_t)
+		 */
+		void serialize(std::vector<uchar>& checkpoint);
+
+		/**
+		 * \brief Restores the tracker's state from a checkpoint written by serialize()
+		 *
+		 * The checkpoint is validated in full before any state is changed, so a tracker is left as it was 
+		 * if restore() fails.
+		 *
+		 * \param checkpoint A pointer to the checkpoint
+		 * \param size The size of the checkpoint in bytes
+		 * \throw runtime_error A runtime error is thrown if the checkpoint is truncated, was written by an
+		 * incompatible version, or holds invalid parameters.
+		 */
+		void restore(const uchar* checkpoint, size_t size);
+#endif
+
+		/**
+		 * \brief Gets the sequence number and times of the frame from which the track was calculated
+		 * \return Returns a reference to the frame times of the latest runCamShift()
+		 * \warning Like getTrack(), getFrameTimes() should only be called by the thread that calls 
+		 * runCamShift(). Other threads find the same frame times in getTrackState().
+		 */
+		const FrameTimes& getFrameTimes();
+
+		/**
+		 * \brief Gets the histogram of runCamShift() latencies
+		 *
+		 * Every runCamShift() records the time it takes, from its start until its results are published.
+		 * The histogram may be read or merged with other trackers' histograms from any thread.
+		 *
+		 * \return Returns a reference to the histogram, in nanoseconds
+		 */
+		LatencyHistogram& getRunLatency();
+
+		/**
+		 * \brief Gets the histogram of capture-to-result ages
+		 *
+		 * Every runCamShift() whose frame was given a capture time records the time from the frame's 
+		 * capture until its results are published, which includes any time the frame spent queued.
+		 *
+		 * \return Returns a reference to the histogram, in nanoseconds
+		 */
+		LatencyHistogram& getCaptureAge();
+
+		/**
+		 * \brief Gets the hardware performance counters sampled around each stage of the pipeline
+		 *
+		 * If PERF_COUNTERS_C is set to 1, each stage of setSelection() and runCamShift() (the conversion to
+		 * HSV, the mask, the backprojection, the threshold, the median blur, the erosion, the dilation and
+		 * the CAMShift algorithm itself) is bracketed by samples of the cycles, instructions, cache misses
+		 * and branch misses spent on the tracking thread. Where the counters are unavailable, nothing is 
+		 * sampled and the tracker runs as usual.
+		 *
+		 * \return Returns a reference to the counters
+		 */
+		PerfCounters& getPerfCounters();
+
+		/**
+		 * \brief Attaches a recorder to which every runCamShift() hands its frame and results
+		 *
+		 * After each frame's results are published, the captured raw frame, the backprojection and the 
+		 * rotated track are queued on the recorder, which encodes them on its own thread. Queueing copies 
+		 * the frame and backprojection, but never waits, so recording costs the tracker about two frame 
+		 * copies. Frames processed by MultiCamShift are recorded too.
+		 *
+		 * \param recorder A pointer to the recorder, or NULL to stop recording
+		 * \warning setRecorder() should be called by the thread that calls runCamShift(), and the recorder
+		 * must outlive its use by this object.
+		 */
+		void setRecorder(DebugRecorder* recorder);
+
+		/**
+		 * \brief Gets the number of backprojection pixels the latest runCamShift() read to find the track
+		 *
+		 * Only counted when ELLIPSE_MOMENTS_C is set. Every pass of the mean shift is counted.
+		 *
+		 * \return Returns the number of pixels read inside the ellipses
+		 */
+		int64_t getPixelsVisited();
+
+		/**
+		 * \brief Gets the number of pixels an axis-aligned window would have read in the same passes
+		 *
+		 * Only counted when ELLIPSE_MOMENTS_C is set. For each pass of the mean shift, the pixels of the 
+		 * ellipse's bounding rectangle within the frame are counted, for comparison with getPixelsVisited().
+		 *
+		 * \return Returns the number of pixels in the ellipses' bounding rectangles
+		 */
+		int64_t getBoundingPixels();
+
+		/**
+		 * \brief Gets the fraction of frames that runCamShift() processed rather than extrapolated
+		 *
+		 * Only counted when DUTY_CYCLE_C is set, since it was last set. Multiplied by the camera's frame 
+		 * rate, it gives the effective processing rate.
+		 *
+		 * \return Returns the fraction of frames processed, from 0 to 1
+		 */
+		double getProcessingRate();
+
+		/**
+		 * \brief Gets the CPU time saved by extrapolating frames rather than processing them
+		 *
+		 * Only counted when DUTY_CYCLE_C is set, since it was last set. Each extrapolated frame is charged
+		 * the CPU time it took, and credited the mean CPU time of the processed frames. The times are read
+		 * from LatencyHistogram::threadCpuNow() around each frame's own work, so neither preemption nor
+		 * other trackers run on the same thread inflate them.
+		 *
+		 * \return Returns the CPU time saved on the tracking thread, in nanoseconds
+		 */
+		int64_t getCpuTimeSaved();
+
+#ifdef CAMSHIFT_EXCEPTIONS
 		/**
 		 * \brief Gets the backprojection
 		 * \return Returns a reference to the backprojection
@@ -138,7 +478,26 @@ namespace camShift {
 		 * \warning runCamShift() should be called prior to calling getRotatedTrack().
 		 */
 		cv::RotatedRect& getRotatedTrack();
+#endif
 
+		/**
+		 * \brief Gets the most recently published results, for use by a thread other than the tracking thread
+		 *
+		 * getBackprojection(), getTrack() and getRotatedTrack() return references to the members that the
+		 * next runCamShift() overwrites, and so should only be used by the thread that calls runCamShift().
+		 * Instead, getTrackState() returns a consistent view of the results of the latest completed 
+		 * runCamShift(). The results are triple buffered: runCamShift() fills a back buffer and then
+		 * publishes it with a single atomic exchange, so neither the tracking thread nor the reader ever 
+		 * waits and nothing, including the backprojection, is copied.
+		 *
+		 * \return Returns a reference to the newest track state. The track state stays unchanged until 
+		 * the next call to getTrackState(). Its backprojection is empty if runCamShift() has not yet 
+		 * completed.
+		 * \warning Only one reader thread may call getTrackState().
+		 */
+		const TrackState& getTrackState();
+
+#ifdef CAMSHIFT_EXCEPTIONS
 		/**
 		 * \brief Sets a specified parameter
 		 *
@@ -146,11 +505,29 @@ namespace camShift {
 		 *
 		 * The ranges in parentheses are possible ranges for the parameters
 		 *
-		 * HUE_BINS_C		- Sets the number of hue bins in the histogram (0 to 179)
-		 * SAT_BINS_C		- Sets the number of saturation bins in the histogram (0 to 255)
-		 * VAL_BINS_C		- Sets the number of value bins in the histogram (0 to 255)
+		 * HUE_BINS_C		- Sets the number of hue bins in the histogram (1 to 256)
+		 * SAT_BINS_C		- Sets the number of saturation bins in the histogram (1 to 256)
+		 * VAL_BINS_C		- Sets the number of value bins in the histogram (1 to 256)
 		 * MEDIAN_BLUR_C	- Sets the size of median blur (odd values greater than 1)
 		 * THRESHOLD_C		- Sets the threshold value (0 to 179)
+		 * SHARED_SCRATCH_C	- Sets whether the per-frame buffers are shared with other trackers (0 or 1)
+		 * LOW_MEMORY_C		- Sets whether the backprojection is generated in strips (0 or 1)
+		 * PLANAR_HSV_C		- Sets whether hue, saturation and value are stored as separate planes (0 or 1)
+		 * LOOK_UP_BINS_C	- Sets whether the histogram and backprojection use bin lookup tables (0 or 1)
+		 * FIXED_POINT_C	- Sets whether the histogram is normalized into 8-bit weights (0 or 1)
+		 * PERF_COUNTERS_C	- Sets whether hardware performance counters are sampled per stage (0 or 1)
+		 * ADAPTIVE_FILTER_C	- Sets the target size at which the filters act as configured (0 to disable, or 
+		 *					  greater than or equal to 8)
+		 * ELLIPSE_MOMENTS_C	- Sets whether the track is found from moments inside the previous ellipse
+		 *					  (0 or 1)
+		 * MOMENT_SAMPLES_C	- Sets the most pixels sampled per pass of the mean shift (0 to sample every 
+		 *					  pixel, or greater than or equal to 256)
+		 * DUTY_CYCLE_C		- Sets the most frames between processed frames (0 to process every frame, or 
+		 *					  greater than or equal to 2)
+		 * BACKGROUND_RING_C	- Sets the width of the ring around the selection whose colors are down-weighted
+		 *					  (0 to disable, or greater than 0)
+		 * COLOR_SPACE_C	- Sets the color space from which the histogram and backprojection are calculated
+		 *					  (a ColorSpace::Space)
 		 *
 		 * Description:
 		 *
@@ -162,13 +539,132 @@ namespace camShift {
 		 * brightness. The number of bins for each channel (i.e. hue, saturation, and value) effectivly changes
 		 * how well and how poorly the backprojections capture the desired object.
 		 *
+		 * The HSV frame and its mask are only needed for the duration of a setSelection() or runCamShift().
+		 * If SHARED_SCRATCH_C is set to 1, those buffers are taken from a scratch pool owned by the calling
+		 * thread and shared by every CamShift object that thread runs, instead of from the CamShift object
+		 * itself. A thread that runs many trackers then holds one set of per-frame buffers rather than one
+		 * set per tracker. Only the histogram, the track and the published results remain per object.
+		 *
+		 * If LOW_MEMORY_C is set to 1, the full-frame HSV frame and mask are never produced. Instead, the 
+		 * captured raw frame is converted, backprojected and filtered a strip of rows at a time, and each 
+		 * strip's result is written into the backprojection. Each strip carries just enough extra rows
+		 * above and below for the median blur, erosion and dilation, so the backprojection is identical to
+		 * the one produced without strips. setSelection() then converts only the selection. The track 
+		 * states are then published without their backprojections, so that a single private 8-bit 
+		 * backprojection, which the CAMShift algorithm needs whole, is rewritten in place by every frame.
+		 * The triple buffer's three published backprojections are released instead. At 1080p, a tracker 
+		 * then holds about 2.3 MB rather than about 14.5 MB.
+		 *
+		 * If PLANAR_HSV_C is set to 1, the captured raw frame is converted into separate hue, saturation and
+		 * value planes rather than one interleaved HSV frame. The value plane is never produced while there
+		 * is only one value bin, in which case the histogram is treated as two dimensional, and the mask is
+		 * skipped entirely since its ranges admit every pixel. The histogram and backprojection then read 
+		 * each plane with unit stride. The planes are converted with SSE2, 32 pixels at a time, and hold 
+		 * exactly the values cvtColor() would produce. LOW_MEMORY_C takes precedence over PLANAR_HSV_C.
+		 *
+		 * Because the HSV values are 8-bit, the bin of each channel value is fixed for a given number of bins.
+		 * Lookup tables from each channel value to its part of the histogram's flat index are therefore 
+		 * rebuilt with every selection, and the histogram's values are stored as 8-bit weights. If 
+		 * LOOK_UP_BINS_C is set to 1, the histogram and backprojection are calculated with those tables in
+		 * integer-only loops, instead of with calcHist() and calcBackProject(). A pixel's bin is then just
+		 * the sum of three table entries, and its backprojection a single byte lookup. The mask's ranges
+		 * are folded into the tables. The results are identical to calcHist() and calcBackProject().
+		 *
+		 * When a run of pixels falls in the same bin, as is usual inside a selection, each increment of that
+		 * bin waits on the store of the one before. The histogram is therefore counted into four interleaved
+		 * sub-histograms, one per pixel of each group of four, which are summed once at the end. A selection
+		 * of 64K pixels or more is also split into bands of rows counted in parallel by OpenCV's threads, each
+		 * band into its own sub-histograms. Since every count is zeroed and summed, bands and sub-histograms
+		 * are only added while there are at least four pixels per count: with many bins, there are fewer
+		 * bands, and then a single histogram shared by each group of four. The counts are kept with the HSV
+		 * frame, so a new selection does not allocate them again.
+		 *
+		 * By default, the histogram holds raw pixel counts, which the backprojection saturates to 255, so 
+		 * with a large selection most of the selection's bins saturate and the threshold barely separates
+		 * them. If FIXED_POINT_C is set to 1, the histogram is instead normalized once per selection so
+		 * that its largest bin has the weight 255, and the backprojection is a lookup of those weights 
+		 * through the tables described above. The threshold then acts on a predictable scale relative to 
+		 * the selection's most common color. FIXED_POINT_C implies LOOK_UP_BINS_C.
+		 *
+		 * The median blur, erosion and dilation have fixed sizes, which suit targets of one size. They erase
+		 * targets much smaller than themselves, and spend full resolution work on targets much larger. If
+		 * ADAPTIVE_FILTER_C is set to a size in pixels, the filters instead scale with the track, whose size
+		 * is taken as the side of a square with the track's area. A track larger than ADAPTIVE_FILTER_C is
+		 * filtered in a copy of the backprojection that is shrunk until the track has that size, which is then
+		 * enlarged back and thresholded halfway, so the backprojection stays binary and the cost of the
+		 * filters no longer grows with the target. A smaller track is filtered at full resolution with the
+		 * median blur and the diamond-shaped erosion and dilation shrunk in proportion, down to skipping them.
+		 * Until there is a track, and in strips when LOW_MEMORY_C is set, the filters are never enlarged
+		 * beyond their configured sizes.
+		 *
+		 * OpenCV's CAMShift algorithm shifts and measures an axis-aligned window, which for an elongated,
+		 * rotated target is mostly background that costs time and biases the moments. If ELLIPSE_MOMENTS_C
+		 * is set to 1, the mean shift and the moments are instead calculated only inside the previous 
+		 * rotated track's ellipse, enlarged by ten pixels on every side. The ellipse is rasterized into one
+		 * span of columns per row, so the inner loop only accumulates. The first frame after a selection 
+		 * uses the ellipse inscribed in the selection. The rotated track is then derived from the moments in
+		 * the same way as OpenCV's, centered on the centroid. See getPixelsVisited().
+		 *
+		 * For an ellipse covering hundreds of thousands of pixels, reading every pixel in every pass of the
+		 * mean shift is more than the centroid needs. If MOMENT_SAMPLES_C is set, the passes instead read a
+		 * regular grid of one pixel in every k by k, with k chosen from the ellipse's area so that it holds
+		 * about MOMENT_SAMPLES_C samples. Once the mean shift converges, one pass at every pixel refines 
+		 * the centroid and measures the rotated track, so the samples only steer where that pass is placed.
+		 * Each sample stands in for its k by k cell, so a sampled centroid lies within about k / 2 pixels of
+		 * the dense one, and the final pass is placed within about k / 2 + 1 pixels of where the dense mean
+		 * shift would converge. Since the ellipse leaves a ten-pixel margin around the target, the final 
+		 * pass's moments, and so the rotated track, match the dense ones unless the target reaches the edge
+		 * of the ellipse. MOMENT_SAMPLES_C implies ELLIPSE_MOMENTS_C.
+		 *
+		 * On battery, the energy spent per tracked second matters more than the speed of each frame. If
+		 * DUTY_CYCLE_C is set to N, runCamShift() processes fewer frames while the target is stationary or
+		 * moving at a steady velocity. Each processed frame is compared with the track extrapolated from the
+		 * previous two, and while the prediction holds to within a quarter of the target's smaller side, the
+		 * gap between processed frames doubles, up to every Nth frame. The frames in between only move the
+		 * rotated track along the measured velocity, and publish the latest backprojection again, shared
+		 * rather than copied, with the extrapolated flag set. The next processed frame returns to the full
+		 * rate if the target moved suddenly, or if the mean backprojection inside the track fell below half of
+		 * its usual level, as when the target is lost or occluded. A sudden motion is therefore noticed up to
+		 * N - 1 frames late. The first frame after a selection, a restore() or a change of resolution is
+		 * always processed. MultiCamShift processes every frame regardless. See getProcessingRate() and
+		 * getCpuTimeSaved().
+		 *
+		 * The histogram only describes the selection, so background colors close to the target's light up
+		 * the backprojection too, which enlarges the track and adds to the work of the filters and the mean
+		 * shift. If BACKGROUND_RING_C is set, setSelection() also counts the histogram of the selection 
+		 * enlarged by a ring of that many pixels, and takes the ring's histogram as the difference. Each bin
+		 * then keeps its count times the share of its color's density that lies inside the selection, so a
+		 * color absent from the ring keeps its count, a color as common in the ring as in the selection 
+		 * keeps half, and a color mostly found in the ring nearly vanishes. Since raw counts would saturate
+		 * the backprojection and hide the weighting, the weighted histogram is scaled so that its largest 
+		 * bin is 255. The ring is clipped to the frame, and has no effect if it holds no pixels in range.
+		 *
+		 * Converting to HSV is the most expensive stage that reads every pixel. If COLOR_SPACE_C is set to
+		 * another ColorSpace::Space, setSelection() and runCamShift() both convert the captured raw frame
+		 * into that space instead, in every mode above. Its channels take the places of hue, saturation and
+		 * value, so HUE_BINS_C, SAT_BINS_C and VAL_BINS_C set the bins of its first, second and third 
+		 * channel, and the third is ignored while it has one bin. Apart from HSV's hue, every channel 
+		 * ranges from 0 to 255. Since a histogram only has meaning in the space it was counted in, changing
+		 * the color space discards the histogram, and the selection must be set again.
+		 *
 		 * \parameter parameter Specifies which parameter to modify
 		 * \parameter newParameter The new value to which the specified parameter is changed
 		 * \throw runtime_error A runtime error is thrown if an attempt is made to set the specified parameter
-		 * to an invalid value.
+		 * to an invalid value, or if the parameter is unknown.
 		 * \see <a href="http://docs.opencv.org/modules/imgproc/doc/filtering.html?highlight=medianblur#medianblur">OpenCV's median blur</a>
 		 */
 		void setParameter(Parameter parameter, long newParameter);
+#endif
+
+		/**
+		 * \brief Sets the value of a specified parameter without throwing
+		 * \param parameter Specifies which parameter to modify
+		 * \param newParameter The new value to which the specified parameter is changed
+		 * \return Returns OK, INVALID_PARAMETER if the parameter is unknown or the value is out of its
+		 * range, in which case nothing is changed, or OPENCV_FAILED
+		 * \see setParameter()
+		 */
+		Status trySetParameter(Parameter parameter, long newParameter) noexcept;
 
 		/**
 		 * \brief Gets the value of a specified parameter
@@ -177,7 +673,28 @@ namespace camShift {
 		 */
 		long getParameter(Parameter parameter);
 
+		/**
+		 * \brief Describes a status of the noexcept API
+		 * \param status The status to describe
+		 * \return Returns the message the throwing API gives for the same failure
+		 */
+		static const char* getStatusMessage(Status status) noexcept;
+
+		/**
+		 * \brief Gets the amount of image memory held by this object
+		 *
+		 * The total includes the HSV frame and mask (or strips) unless SHARED_SCRATCH_C is set, the histogram,
+		 * and the backprojections of all published track states, each counted once however many states share
+		 * it, and any kept for reuse. At 1080p, a tracker holds about 14.5 MB with its own buffers and about
+		 * 6.2 MB with shared buffers.
+		 *
+		 * \return Returns the number of bytes of image data owned by this object
+		 */
+		size_t getMemoryUsage();
+
 	private:
+		friend class MultiCamShift;
+
 		enum { 
 			HUE_MIN = 0, 
 			HUE_MAX = 180, 
@@ -192,29 +709,151 @@ namespace camShift {
 			HEIGHT_MAXI = 20,
 			THRESHOLD = 40,
 			MEDIAN_BLUR = 3,
-			CHANNELS = 3
+			CHANNELS = 3,
+			STRIP_ROWS = 16,
+			OUT_OF_RANGE = 1 << 24,
+			MOMENT_TOLERANCE = 10,
+			MEAN_SHIFT_ITERATIONS = 10,
+			PREDICTION_TOLERANCE = 4,
+			SUB_HISTOGRAMS = 4,
+			PARALLEL_HISTOGRAM_PIXELS = 1 << 16,
+			PIXELS_PER_COUNT = 4
 		};
+		enum { M00, M10, M01, M20, M11, M02, MOMENTS };
+		enum { CHECKPOINT_MAGIC = 0x4B435343, CHECKPOINT_VERSION = 6 };
 		enum { HUE = 0, SAT = 1, VAL = 2, MINI = 0, MAXI = 1 };
 
+		class HistogramBands;
+
+		struct Scratch {
+			cv::Mat hsvFrame;
+			cv::Mat maskFrame;
+			cv::Mat hsvStrip;
+			cv::Mat maskStrip;
+			cv::Mat backProjectionStrip;
+			cv::Mat hsvPlanes[CHANNELS];
+			cv::Mat planeMask;
+			bool planesMasked;
+			cv::Mat filterFrame;
+			std::vector<int> binCounts;
+			Scratch() : planesMasked(false) { }
+		};
+
 		cv::Mat capturedRawFrame;
+		cv::Size capturedFrameSize;
+		FrameTimes frameTimes;
+		FrameTimes publishedFrameTimes;
+		LatencyHistogram runLatency;
+		LatencyHistogram captureAge;
+		PerfCounters perfCounters;
+		DebugRecorder* recorder;
 
 		float histoRanges[CHANNELS][2];
+		const float* constantHistoRanges[CHANNELS];
+		int binTables[CHANNELS][256];
+		int binCount;
+		std::vector<uchar> binWeights;
 		cv::Scalar maskRanges[2];
 		cv::Rect track;
 		cv::RotatedRect trackRotated;
-		cv::Mat hsvFrame;
-		cv::Mat maskFrame;
+		Scratch ownScratch;
+		bool sharedScratch;
+		bool lowMemory;
+		bool planarHsv;
+		bool lookUpBins;
+		bool fixedPoint;
+		bool ellipseMoments;
+		int momentSamples;
+		long ellipseSelectionCount;
+		int64_t pixelsVisited;
+		int64_t boundingPixels;
+		int dutyCycle;
+		int dutyStride;
+		int dutySkipped;
+		long dutySelectionCount;
+		cv::Point2f dutyCenter;
+		cv::Point2f dutyVelocity;
+		double dutyDensity;
+		int64_t framesProcessed;
+		int64_t framesExtrapolated;
+		int64_t processingTime;
+		int64_t extrapolationTime;
 		cv::Mat histoFrame;
+		cv::Mat selectedHistoFrame;
 		cv::Mat backProjectionFrame;
+		cv::Mat stripsBackprojection;
 		cv::Mat erosionElement;
 		cv::Mat dilationElement;
+		std::vector<cv::Mat> diamondElements;
+		int adaptiveFilterSize;
+		int backgroundRing;
+		ColorSpace::Space colorSpace;
 		int histoBins[CHANNELS];
 		int medianBlurAmount;
 		int thresholdAmount;
 		int channels[CHANNELS];
+		long selectionCount;
+		long weightsCount;
+		TripleBuffer<TrackState> trackStates;
+		std::vector<cv::Mat> spareBackprojections;
+
+		Scratch& setHsvFrame();
+		Scratch& setHsvFrame(const cv::Rect& area);
+		Scratch& setHsvPlanes(int planeCount);
+		int getPlaneCount(int valueBins);
+		void backProjectPlanes(Scratch& scratch, cv::Mat& backprojection);
+		void backProject(cv::Mat& hsv, cv::Mat& mask, cv::Mat& backprojection);
+		void filterBackprojection(cv::Mat& frame);
+		void applyFilters(cv::Mat& backprojection, int medianBlur, const cv::Mat& erosion, const cv::Mat& dilation);
+		const cv::Mat& getDiamondElement(int radius);
+		void backProjectStrips();
+		void trackBackprojection();
+		cv::RotatedRect trackEllipse(const cv::RotatedRect& region);
+		int64_t accumulateEllipse(cv::Point2d center, double semiWidth, double semiHeight, double angle, int step, double* moments);
+		Scratch& getScratch();
+		void rescaleTrack(cv::Size oldFrameSize, cv::Size newFrameSize);
+		static void resizeView(cv::Mat& frame, cv::Size size, int type);
+		Status checkFrame() const noexcept;
+		Status checkSelection(const cv::Rect& selection) const noexcept;
+		static Status checkFormat(cv::Size frameSize, int pixelFormat) noexcept;
+		static void throwStatus(Status status);
+
+		/* Runs a step of the noexcept API, turning any error OpenCV raises into a status */
+		template <typename Step> static Status guard(Step step) noexcept {
+#ifdef CAMSHIFT_EXCEPTIONS
+			try {
+				step();
+			} catch (...) {
+				return OPENCV_FAILED;
+			}
+#else
+			step();
+#endif
+			return OK;
+		}
 
-		void setHsvFrame();
+		void selectHistogram(const cv::Rect& selection);
+		void calcHistogram(const cv::Mat* frames, int frameCount, const cv::Mat& mask, const int (*tables)[256], int count, cv::Mat& histogram);
+		static void weighHistogram(cv::Mat& histogram, const cv::Mat& areaHisto);
+		bool processFrame();
+		void allocateBuffers(cv::Size frameSize, int pixelFormat);
+		const char* changeParameter(Parameter parameter, long newParameter);
+		void updateTrack();
+		void claimBackBuffer(cv::Size frameSize);
+		bool isPublished(const cv::Mat& backprojection);
+		bool extrapolateTrack();
+		void updateDutyCycle();
+		void publishTrackState(bool extrapolated);
+		void countFrame(bool extrapolated, int64_t cpuTime);
 		const float** getConstantHistoRanges();
+		void setBinTables();
+		int buildBinTables(int (*tables)[256]) const;
+		static bool areBinsValid(const int* bins);
+		void setBinWeights();
+		static void getRowChannels(const cv::Mat* frames, int frameCount, int y, const uchar** rows, int* steps);
+		void calcHistLut(const cv::Mat* frames, int frameCount, const int (*tables)[256], int count, cv::Mat& histogram);
+		static void countBins(const cv::Mat* frames, int frameCount, const int (*tables)[256], int count, int firstRow, int lastRow, int* counts, int subStride);
+		void backProjectLut(const cv::Mat* frames, int frameCount, cv::Mat& backprojection);
 	};
 };
 
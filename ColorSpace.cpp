@@ -0,0 +1,333 @@
+/** \author Andrew Powell \date August 30th, 2014 */
+
+#include "ColorSpace.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <climits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLOR_SPACE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+	/* Fixed-point reciprocals used by OpenCV's 8-bit BGR to HSV conversion, so the planes match cvtColor() */
+	struct HsvTables {
+		enum { SHIFT = 12, HUE_RANGE = 180 };
+		int saturation[256];
+		int hue[256];
+		HsvTables() {
+			saturation[0] = hue[0] = 0;
+			for (int i = 1; i < 256; i++) {
+				saturation[i] = cv::saturate_cast<int>((255 << SHIFT) / (1. * i));
+				hue[i] = cv::saturate_cast<int>((HUE_RANGE << SHIFT) / (6. * i));
+			}
+		}
+	};
+
+	/* The intensity is the sum times 21846 / 65536, which is the sum divided by three for every sum up to 765 */
+	enum { THIRD = 21846 };
+
+	/* Luma and chroma coefficients of BT.601, in 8 and 7 fractional bits so that every product fits 16 bits */
+	enum { Y_B = 29, Y_G = 150, Y_R = 77, Y_SHIFT = 8, CR_R = 91, CB_B = 72, C_SHIFT = 7, C_OFFSET = 128 };
+
+	/*
+	 * Each space converts one pixel with pixel(), and 32 pixels with vector(), whose six registers hold
+	 * the first and last 16 pixels of the first channel, then of the second and of the third. Both give
+	 * identical results, so a row may be split between them anywhere.
+	 */
+	struct RgChromaticity {
+		static void pixel(int b, int g, int r, uchar* out) {
+			int sum = b + g + r;
+
+			/* Truncated rather than rounded, since a multiply and add could be fused into one rounding */
+			float scale = 255.5f / std::max(sum, 1);
+			out[0] = (uchar)(int)(r * scale);
+			out[1] = (uchar)(int)(g * scale);
+			out[2] = (uchar)((sum * THIRD) >> 16);
+		}
+#ifdef COLOR_SPACE_SSE2
+		static __m128i scale(__m128i channel, __m128 scaleLow, __m128 scaleHigh) {
+			__m128i zero = _mm_setzero_si128();
+			__m128i low = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(channel, zero)), scaleLow));
+			__m128i high = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(channel, zero)), scaleHigh));
+			return _mm_packs_epi32(low, high);
+		}
+
+		static void eight(__m128i b, __m128i g, __m128i r, __m128i* out) {
+			__m128i zero = _mm_setzero_si128();
+			__m128i sum = _mm_add_epi16(_mm_add_epi16(b, g), r);
+			__m128 one = _mm_set1_ps(1.f);
+			__m128 numerator = _mm_set1_ps(255.5f);
+			__m128 scaleLow = _mm_div_ps(numerator, _mm_max_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(sum, zero)), one));
+			__m128 scaleHigh = _mm_div_ps(numerator, _mm_max_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(sum, zero)), one));
+			out[0] = scale(r, scaleLow, scaleHigh);
+			out[1] = scale(g, scaleLow, scaleHigh);
+			out[2] = _mm_mulhi_epu16(sum, _mm_set1_epi16((short)THIRD));
+		}
+
+		static void vector(const __m128i* bgr, __m128i* out);
+#endif
+	};
+
+	struct YCrCb {
+		static void pixel(int b, int g, int r, uchar* out) {
+			int y = (b * Y_B + g * Y_G + r * Y_R + (1 << (Y_SHIFT - 1))) >> Y_SHIFT;
+			out[0] = cv::saturate_cast<uchar>((((r - y) * CR_R + (1 << (C_SHIFT - 1))) >> C_SHIFT) + C_OFFSET);
+			out[1] = cv::saturate_cast<uchar>((((b - y) * CB_B + (1 << (C_SHIFT - 1))) >> C_SHIFT) + C_OFFSET);
+			out[2] = (uchar)y;
+		}
+#ifdef COLOR_SPACE_SSE2
+		static void eight(__m128i b, __m128i g, __m128i r, __m128i* out) {
+			/* The luma's sum stays below 65536, so it is shifted as unsigned */
+			__m128i y = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(Y_B)), _mm_mullo_epi16(g, _mm_set1_epi16(Y_G))),
+				_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(Y_R)), _mm_set1_epi16(1 << (Y_SHIFT - 1))));
+			y = _mm_srli_epi16(y, Y_SHIFT);
+			__m128i round = _mm_set1_epi16(1 << (C_SHIFT - 1));
+			__m128i offset = _mm_set1_epi16(C_OFFSET);
+			out[0] = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(r, y), _mm_set1_epi16(CR_R)), round), C_SHIFT), offset);
+			out[1] = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, y), _mm_set1_epi16(CB_B)), round), C_SHIFT), offset);
+			out[2] = y;
+		}
+
+		static void vector(const __m128i* bgr, __m128i* out);
+#endif
+	};
+
+	/*
+	 * HSV with OpenCV's 8-bit formula. The vector path computes each pixel's reciprocals with a single
+	 * precision division instead of looking them up, which rounds to the same value as the tables for
+	 * every divisor from 1 to 255, and multiplies in 32 bits since the products exceed 16.
+	 */
+	struct Hsv {
+		static void pixel(int b, int g, int r, uchar* out) {
+			static const HsvTables tables;
+			int v = std::max(b, std::max(g, r));
+			int diff = v - std::min(b, std::min(g, r));
+			int vr = v == r ? -1 : 0;
+			int vg = v == g ? -1 : 0;
+			int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + (~vg & (r - g + 4 * diff))));
+			h = (h * tables.hue[diff] + (1 << (HsvTables::SHIFT - 1))) >> HsvTables::SHIFT;
+			out[0] = (uchar)(h < 0 ? h + HsvTables::HUE_RANGE : h);
+			out[1] = (uchar)((diff * tables.saturation[v] + (1 << (HsvTables::SHIFT - 1))) >> HsvTables::SHIFT);
+			out[2] = (uchar)v;
+		}
+#ifdef COLOR_SPACE_SSE2
+		/* SSE2 has no 32-bit multiply that keeps the low half, so the even and odd lanes are multiplied apart */
+		static __m128i multiply(__m128i a, __m128i b) {
+			__m128i even = _mm_mul_epu32(a, b);
+			__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+			return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+		}
+
+		static __m128i four(__m128i h, __m128i diff, __m128i v, __m128i* saturation) {
+			__m128 one = _mm_set1_ps(1.f);
+			__m128i round = _mm_set1_epi32(1 << (HsvTables::SHIFT - 1));
+			__m128i hueScale = _mm_cvtps_epi32(_mm_div_ps(_mm_set1_ps((float)(HsvTables::HUE_RANGE << HsvTables::SHIFT) / 6), 
+				_mm_max_ps(_mm_cvtepi32_ps(diff), one)));
+			__m128i saturationScale = _mm_cvtps_epi32(_mm_div_ps(_mm_set1_ps((float)(255 << HsvTables::SHIFT)), 
+				_mm_max_ps(_mm_cvtepi32_ps(v), one)));
+			h = _mm_srai_epi32(_mm_add_epi32(multiply(h, hueScale), round), HsvTables::SHIFT);
+			h = _mm_add_epi32(h, _mm_and_si128(_mm_cmplt_epi32(h, _mm_setzero_si128()), _mm_set1_epi32(HsvTables::HUE_RANGE)));
+			*saturation = _mm_srai_epi32(_mm_add_epi32(multiply(diff, saturationScale), round), HsvTables::SHIFT);
+			return h;
+		}
+
+		static void eight(__m128i b, __m128i g, __m128i r, __m128i* out) {
+			__m128i zero = _mm_setzero_si128();
+			__m128i v = _mm_max_epi16(_mm_max_epi16(b, g), r);
+			__m128i diff = _mm_sub_epi16(v, _mm_min_epi16(_mm_min_epi16(b, g), r));
+			__m128i vr = _mm_cmpeq_epi16(v, r);
+			__m128i vg = _mm_cmpeq_epi16(v, g);
+			__m128i h = _mm_add_epi16(_mm_and_si128(vr, _mm_sub_epi16(g, b)), _mm_andnot_si128(vr, _mm_add_epi16(
+				_mm_and_si128(vg, _mm_add_epi16(_mm_sub_epi16(b, r), _mm_add_epi16(diff, diff))),
+				_mm_andnot_si128(vg, _mm_add_epi16(_mm_sub_epi16(r, g), _mm_slli_epi16(diff, 2))))));
+
+			/* The hue is sign extended and the others zero extended into 32 bits, four pixels at a time */
+			__m128i saturationLow, saturationHigh;
+			__m128i hueLow = four(_mm_srai_epi32(_mm_unpacklo_epi16(h, h), 16), _mm_unpacklo_epi16(diff, zero), 
+				_mm_unpacklo_epi16(v, zero), &saturationLow);
+			__m128i hueHigh = four(_mm_srai_epi32(_mm_unpackhi_epi16(h, h), 16), _mm_unpackhi_epi16(diff, zero), 
+				_mm_unpackhi_epi16(v, zero), &saturationHigh);
+			out[0] = _mm_packs_epi32(hueLow, hueHigh);
+			out[1] = _mm_packs_epi32(saturationLow, saturationHigh);
+			out[2] = v;
+		}
+
+		static void vector(const __m128i* bgr, __m128i* out);
+#endif
+	};
+
+	struct Bgr {
+		static void pixel(int b, int g, int r, uchar* out) {
+			out[0] = (uchar)b;
+			out[1] = (uchar)g;
+			out[2] = (uchar)r;
+		}
+#ifdef COLOR_SPACE_SSE2
+		static void vector(const __m128i* bgr, __m128i* out) {
+			for (int i = 0; i < 6; i++)
+				out[i] = bgr[i];
+		}
+#endif
+	};
+
+#ifdef COLOR_SPACE_SSE2
+	/* Widens 16 pixels of each channel into two halves of eight, converts each, and packs them back with saturation */
+	template <class Pixels> void widen(const __m128i* bgr, __m128i* out) {
+		__m128i zero = _mm_setzero_si128();
+		for (int half = 0; half < 2; half++) {
+			__m128i low[3], high[3];
+			Pixels::eight(_mm_unpacklo_epi8(bgr[half], zero), _mm_unpacklo_epi8(bgr[2 + half], zero), _mm_unpacklo_epi8(bgr[4 + half], zero), low);
+			Pixels::eight(_mm_unpackhi_epi8(bgr[half], zero), _mm_unpackhi_epi8(bgr[2 + half], zero), _mm_unpackhi_epi8(bgr[4 + half], zero), high);
+			for (int c = 0; c < 3; c++)
+				out[2 * c + half] = _mm_packus_epi16(low[c], high[c]);
+		}
+	}
+
+	void RgChromaticity::vector(const __m128i* bgr, __m128i* out) {
+		widen<RgChromaticity>(bgr, out);
+	}
+
+	void YCrCb::vector(const __m128i* bgr, __m128i* out) {
+		widen<YCrCb>(bgr, out);
+	}
+
+	void Hsv::vector(const __m128i* bgr, __m128i* out) {
+		widen<Hsv>(bgr, out);
+	}
+
+	/*
+	 * Five rounds of interleaving the bytes of registers i and i + 3 turn 32 interleaved pixels into
+	 * 16 pixels per register, first and last 16 of each channel in turn. Each round is a fixed
+	 * permutation, and five of them bring every byte back to its channel in order.
+	 */
+	void deinterleave(__m128i* v) {
+		for (int round = 0; round < 5; round++) {
+			__m128i next[6];
+			for (int i = 0; i < 3; i++) {
+				next[2 * i] = _mm_unpacklo_epi8(v[i], v[i + 3]);
+				next[2 * i + 1] = _mm_unpackhi_epi8(v[i], v[i + 3]);
+			}
+			for (int i = 0; i < 6; i++)
+				v[i] = next[i];
+		}
+	}
+
+	/* Undoes five rounds of deinterleave(), by taking the even and odd bytes of each pair of registers apart */
+	void interleave(__m128i* v) {
+		__m128i lowBytes = _mm_set1_epi16(0x00FF);
+		for (int round = 0; round < 5; round++) {
+			__m128i next[6];
+			for (int i = 0; i < 3; i++) {
+				next[i] = _mm_packus_epi16(_mm_and_si128(v[2 * i], lowBytes), _mm_and_si128(v[2 * i + 1], lowBytes));
+				next[i + 3] = _mm_packus_epi16(_mm_srli_epi16(v[2 * i], 8), _mm_srli_epi16(v[2 * i + 1], 8));
+			}
+			for (int i = 0; i < 6; i++)
+				v[i] = next[i];
+		}
+	}
+#endif
+
+	/* Converts a row into outputs spaced step bytes apart, 1 for planes and 3 for an interleaved frame; a null output is skipped */
+	template <class Pixels> void convertRow(const uchar* bgr, int cols, uchar** outputs, int step) {
+		int x = 0;
+#ifdef COLOR_SPACE_SSE2
+		for (; x + 32 <= cols; x += 32) {
+			__m128i v[6];
+			for (int i = 0; i < 6; i++)
+				v[i] = _mm_loadu_si128((const __m128i*)(bgr + 3 * x + 16 * i));
+			deinterleave(v);
+			__m128i out[6];
+			Pixels::vector(v, out);
+			if (step == 1) {
+				for (int c = 0; c < 3; c++) {
+					if (outputs[c] == NULL)
+						continue;
+					_mm_storeu_si128((__m128i*)(outputs[c] + x), out[2 * c]);
+					_mm_storeu_si128((__m128i*)(outputs[c] + x + 16), out[2 * c + 1]);
+				}
+			} else {
+				interleave(out);
+				for (int i = 0; i < 6; i++)
+					_mm_storeu_si128((__m128i*)(outputs[0] + 3 * x + 16 * i), out[i]);
+			}
+		}
+#endif
+		for (; x < cols; x++) {
+			uchar out[3];
+			Pixels::pixel(bgr[3 * x], bgr[3 * x + 1], bgr[3 * x + 2], out);
+			for (int c = 0; c < 3; c++) {
+				if (outputs[c] != NULL)
+					outputs[c][step * x] = out[c];
+			}
+		}
+	}
+
+	template <class Pixels> void convertFrame(const cv::Mat& bgr, cv::Mat* planes, int planeCount, cv::Mat& features) {
+		for (int y = 0; y < bgr.rows; y++) {
+			uchar* outputs[3] = { NULL, NULL, NULL };
+			if (planes != NULL) {
+				for (int c = 0; c < planeCount; c++)
+					outputs[c] = planes[c].ptr<uchar>(y);
+				convertRow<Pixels>(bgr.ptr<uchar>(y), bgr.cols, outputs, 1);
+			} else {
+				uchar* row = features.ptr<uchar>(y);
+				for (int c = 0; c < 3; c++)
+					outputs[c] = row + c;
+				convertRow<Pixels>(bgr.ptr<uchar>(y), bgr.cols, outputs, 3);
+			}
+		}
+	}
+
+	void convertSpace(camShift::ColorSpace::Space space, const cv::Mat& bgr, cv::Mat* planes, int planeCount, cv::Mat& features) {
+		switch (space) {
+		case camShift::ColorSpace::RG_CHROMATICITY: convertFrame<RgChromaticity>(bgr, planes, planeCount, features); break;
+		case camShift::ColorSpace::HSV:				convertFrame<Hsv>(bgr, planes, planeCount, features); break;
+		case camShift::ColorSpace::YCRCB:			convertFrame<YCrCb>(bgr, planes, planeCount, features); break;
+		default:									convertFrame<Bgr>(bgr, planes, planeCount, features); break;
+		}
+	}
+}
+
+namespace camShift {
+
+	void ColorSpace::convert(Space space, const cv::Mat& bgr, cv::Mat& features) {
+		if (space == HSV) {
+			cv::cvtColor(bgr, features, cv::COLOR_BGR2HSV);
+			return;
+		}
+		features.create(bgr.size(), CV_8UC3);
+		if (space == BGR)
+			bgr.copyTo(features);
+		else
+			convertSpace(space, bgr, NULL, 0, features);
+	}
+
+	void ColorSpace::convertPlanes(Space space, const cv::Mat& bgr, cv::Mat* planes, int planeCount) {
+		convertSpace(space, bgr, planes, planeCount, planes[0]);
+	}
+
+	int ColorSpace::getLargest(Space space, int channel) {
+		return space == HSV && channel == 0 ? HsvTables::HUE_RANGE - 1 : UCHAR_MAX;
+	}
+
+	const char* ColorSpace::getName(Space space) {
+		switch (space) {
+		case HSV:				return "hsv";
+		case RG_CHROMATICITY:	return "rg chromaticity";
+		case YCRCB:				return "ycrcb";
+		case BGR:				return "bgr";
+		default:				return "unknown";
+		}
+	}
+
+	bool ColorSpace::isVectorized() {
+#ifdef COLOR_SPACE_SSE2
+		return true;
+#else
+		return false;
+#endif
+	}
+};
@@ -0,0 +1,85 @@
+/** \author Andrew Powell \date August 30th, 2014 */
+
+#ifndef COLOR_SPACE_H_
+#define COLOR_SPACE_H_
+
+#include <opencv2/core/core.hpp>
+
+
+namespace camShift {
+
+	/**
+	 * \brief Converts BGR frames into the color spaces from which the CamShift class can backproject
+	 *
+	 * HSV separates color from brightness well, but its hue needs a division per pixel and is undefined
+	 * for grays. The other spaces trade some of that separation for a cheaper conversion:
+	 *
+	 * RG_CHROMATICITY	- Red and green divided by the sum of the three channels, which cancels the
+	 *					  brightness, scaled so that each lies from 0 to 255. The third channel is the
+	 *					  intensity, the sum divided by three.
+	 * YCRCB			- The red and blue differences from the luma, with 8-bit and 7-bit fixed-point
+	 *					  coefficients, followed by the luma. No division is needed.
+	 * BGR				- The captured raw frame itself, quantized only by the histogram's bins.
+	 *
+	 * Every space has three 8-bit channels ordered like hue, saturation and value, so the channel that
+	 * carries the most brightness, if any, comes last and is ignored while there is only one value bin.
+	 * BGR has no such channel, so all three of its channels should be given bins. The first channel of
+	 * HSV ranges from 0 to 179, and every other channel from 0 to 255.
+	 *
+	 * An interleaved HSV frame is converted with cvtColor(). Every other conversion, HSV planes included,
+	 * is done with SSE2 where the compiler targets it, 32 pixels at a time, and with scalar code that
+	 * gives identical results elsewhere and for the last pixels of each row. HSV planes follow 
+	 * cvtColor()'s fixed-point formula, so they match it exactly.
+	 *
+	 * \author Andrew Powell
+	 * \date August 30th, 2014
+	 */
+	class ColorSpace {
+	public:
+
+		/** \brief An enumerator type used to specify a color space. See CamShift::COLOR_SPACE_C */
+		enum Space { HSV, RG_CHROMATICITY, YCRCB, BGR, SPACES };
+
+		/**
+		 * \brief Converts a BGR frame into one interleaved frame of the color space
+		 * \param space Specifies the color space
+		 * \param bgr A reference to the CV_8UC3 frame to convert
+		 * \param features A reference to the frame that receives the color space's channels, which is
+		 * only reallocated if its size or type differ
+		 */
+		static void convert(Space space, const cv::Mat& bgr, cv::Mat& features);
+
+		/**
+		 * \brief Converts a BGR frame into separate planes of the color space
+		 * \param space Specifies the color space
+		 * \param bgr A reference to the CV_8UC3 frame to convert
+		 * \param planes A pointer to the planes that receive the color space's channels, which must be
+		 * CV_8UC1 and of the frame's size
+		 * \param planeCount The number of planes to produce, 2 to skip the last channel or 3
+		 */
+		static void convertPlanes(Space space, const cv::Mat& bgr, cv::Mat* planes, int planeCount);
+
+		/**
+		 * \brief Gets the largest value a channel of the color space takes
+		 * \param space Specifies the color space
+		 * \param channel The index of the channel
+		 * \return Returns 179 for the hue of HSV, and 255 otherwise
+		 */
+		static int getLargest(Space space, int channel);
+
+		/**
+		 * \brief Gets the name of a color space
+		 * \param space Specifies the color space
+		 * \return Returns the name of the color space
+		 */
+		static const char* getName(Space space);
+
+		/**
+		 * \brief Gets whether the conversions other than cvtColor()'s were compiled with SSE2
+		 * \return Returns true if the conversions are vectorized
+		 */
+		static bool isVectorized();
+	};
+};
+
+#endif
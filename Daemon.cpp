@@ -0,0 +1,58 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#include <iostream>
+#include <thread>
+#include <exception>
+#include <csignal>
+#include <pthread.h>
+#include <unistd.h>
+#include "TrackingDaemon.h"
+
+using namespace camShift;
+using namespace std;
+
+int main(int argc, char* argv[]) {
+
+	/*
+	 * Instructions:
+	 *
+	 * The program hosts CamShift objects for TrackingClient objects in other processes, until it is
+	 * interrupted or terminated. The optional argument sets the path of the daemon's socket.
+	 */
+
+	try {
+		const char* socketPath = argc > 1 ? argv[1] : "/tmp/camshift.sock";
+
+		/* The signals are waited for below, rather than handled, since stop() is not async-signal-safe */
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+		TrackingDaemon daemon(socketPath);
+		exception_ptr failure;
+		thread server([&]() {
+			try {
+				daemon.run();
+			} catch (...) {
+				failure = current_exception();
+				kill(getpid(), SIGTERM);
+			}
+		});
+		cout << "Tracking daemon listening on " << socketPath << endl;
+
+		int received;
+		sigwait(&signals, &received);
+		daemon.stop();
+		server.join();
+		if (failure)
+			rethrow_exception(failure);
+
+	/* Report any errors */
+	} catch (exception& e) {
+		cout << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,137 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <cstdlib>
+#include <cmath>
+#include <unistd.h>
+#include "TrackingDaemon.h"
+#include "TrackingClient.h"
+#include "LatencyHistogram.h"
+
+using namespace camShift;
+using namespace std;
+
+const cv::Size frameSize(640, 480);
+
+/* A red ellipse circling over a noisy background, at a different phase for each client */
+cv::RotatedRect getTarget(int client, int frame) {
+	float radius = frameSize.height / 10.f;
+	float t = frame / 30.f + client;
+	cv::Point2f center(frameSize.width / 2 + frameSize.height / 3 * cos(t), frameSize.height / 2 + frameSize.height / 3 * sin(t));
+	return cv::RotatedRect(center, cv::Size2f(2 * radius, 1.5f * radius), 0);
+}
+
+void drawFrame(int client, int frame, cv::Mat& capturedRawFrame) {
+	cv::RNG rng(frame);
+	rng.fill(capturedRawFrame, cv::RNG::UNIFORM, cv::Scalar(0, 0, 0), cv::Scalar(90, 90, 90));
+	cv::ellipse(capturedRawFrame, getTarget(client, frame), cv::Scalar(30, 30, 220), -1);
+}
+
+/* Tracks one target through the daemon, recording each frame's round trip and the daemon's share of it */
+void runClient(const string& socketPath, int client, int frames, LatencyHistogram& roundTrips,
+		LatencyHistogram& processing, LatencyHistogram& overheads) {
+	TrackingClient trackingClient(socketPath);
+	cv::Mat capturedRawFrame(frameSize, CV_8UC3, trackingClient.attachFrames(frameSize.width, frameSize.height));
+	drawFrame(client, 0, capturedRawFrame);
+	int target = trackingClient.createTarget();
+	cv::Rect selection = getTarget(client, 0).boundingRect();
+	trackingClient.setSelection(target, selection.x + selection.width / 4, selection.y + selection.height / 4,
+		selection.width / 2, selection.height / 2);
+
+	vector<TrackingProtocol::Result> results;
+	for (int frame = 1; frame <= frames; frame++) {
+		drawFrame(client, frame, capturedRawFrame);
+		int64_t start = LatencyHistogram::now();
+		trackingClient.runFrame(frame, start, results);
+		int64_t roundTrip = LatencyHistogram::now() - start;
+		if (results[0].status != CamShift::OK)
+			throw std::runtime_error(CamShift::getStatusMessage((CamShift::Status)results[0].status));
+		int64_t processed = results[0].completionTime - results[0].startTime;
+		roundTrips.record(roundTrip);
+		processing.record(processed);
+		overheads.record(roundTrip - processed);
+	}
+}
+
+int main(int argc, char* argv[]) {
+
+	/*
+	 * Instructions:
+	 *
+	 * The benchmark starts a TrackingDaemon in this process and connects a growing number of local
+	 * TrackingClient objects to it, each in its own thread and each tracking one target in its own 640x480
+	 * frames. For every number of clients, a row of the table reports the total frame rate, and the median
+	 * and 99th percentile of each frame's round trip, of the daemon's processing, and of the overhead of
+	 * the daemon, which is the round trip less the processing. The overhead covers the socket messages and
+	 * the waking of the daemon's and client's threads; no frame is copied. Once there are more clients
+	 * than cores, the overhead also includes the time each frame waits to be scheduled.
+	 *
+	 * The optional argument sets the number of frames per client.
+	 */
+
+	try {
+		int frames = argc > 1 ? atoi(argv[1]) : 200;
+		ostringstream socketPath;
+		socketPath << "/tmp/camshift-benchmark-" << getpid() << ".sock";
+		TrackingDaemon daemon(socketPath.str());
+		thread server([&]() { daemon.run(); });
+
+		cout << left << setw(9) << "clients" << right << setw(9) << "fps"
+			<< setw(14) << "trip p50 us" << setw(14) << "trip p99 us"
+			<< setw(14) << "proc p50 us" << setw(14) << "proc p99 us"
+			<< setw(14) << "ipc p50 us" << setw(14) << "ipc p99 us" << endl;
+
+		const int clientCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+		for (int c = 0; c < 7; c++) {
+			LatencyHistogram roundTrips;
+			LatencyHistogram processing;
+			LatencyHistogram overheads;
+			mutex failureMutex;
+			exception_ptr failure;
+
+			int64_t start = LatencyHistogram::now();
+			vector<thread> clients;
+			for (int i = 0; i < clientCounts[c]; i++) {
+				clients.push_back(thread([&, i]() {
+					try {
+						runClient(socketPath.str(), i, frames, roundTrips, processing, overheads);
+					} catch (...) {
+						lock_guard<mutex> lock(failureMutex);
+						failure = current_exception();
+					}
+				}));
+			}
+			for (size_t i = 0; i < clients.size(); i++)
+				clients[i].join();
+			double seconds = (LatencyHistogram::now() - start) / 1e9;
+			if (failure) {
+				daemon.stop();
+				server.join();
+				rethrow_exception(failure);
+			}
+
+			cout << left << setw(9) << clientCounts[c] << right << fixed << setprecision(1)
+				<< setw(9) << clientCounts[c] * frames / seconds
+				<< setw(14) << roundTrips.getPercentile(50) / 1e3 << setw(14) << roundTrips.getPercentile(99) / 1e3
+				<< setw(14) << processing.getPercentile(50) / 1e3 << setw(14) << processing.getPercentile(99) / 1e3
+				<< setw(14) << overheads.getPercentile(50) / 1e3 << setw(14) << overheads.getPercentile(99) / 1e3 << endl;
+		}
+
+		daemon.stop();
+		server.join();
+
+	/* Report any errors */
+	} catch (exception& e) {
+		cout << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
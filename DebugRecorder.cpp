@@ -0,0 +1,132 @@
+/** \author Andrew Powell \date August 23rd, 2014 */
+
+#include "DebugRecorder.h"
+#include "CamShift.h" // for CAMSHIFT_EXCEPTIONS
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace camShift {
+
+	DebugRecorder::DebugRecorder(const std::string& path, double fps, int capacity) :
+			path(path),
+			fps(fps),
+			entries(std::max(capacity, 1)),
+			head(0),
+			tail(0),
+			queued(0),
+			recorded(0),
+			dropped(0),
+			failed(false),
+			stopping(false) {
+		writer = std::thread(&DebugRecorder::write, this);
+	}
+
+	DebugRecorder::~DebugRecorder() {
+		stopping = true;
+		wake.notify_one();
+		writer.join();
+	}
+
+	bool DebugRecorder::record(const cv::Mat& capturedRawFrame, const cv::Mat& backprojection, const cv::RotatedRect& rotatedTrack, int64_t sequence) {
+		/* Only the producer counts drops, so each refused frame is counted exactly once */
+		uint64_t next = head.load(std::memory_order_relaxed);
+		if (failed.load(std::memory_order_relaxed) || next - tail.load(std::memory_order_acquire) == entries.size()) {
+			dropped++;
+			return false;
+		}
+
+		/* The entry's storage is reused, so only the first frame of each size allocates */
+		Entry& entry = entries[next % entries.size()];
+		capturedRawFrame.copyTo(entry.capturedRawFrame);
+		backprojection.copyTo(entry.backprojection);
+		entry.rotatedTrack = rotatedTrack;
+		entry.sequence = sequence;
+		head.store(next + 1, std::memory_order_release);
+		queued++;
+		wake.notify_one();
+		return true;
+	}
+
+	int64_t DebugRecorder::getQueuedCount() const {
+		return queued.load();
+	}
+
+	int64_t DebugRecorder::getRecordedCount() const {
+		return recorded.load();
+	}
+
+	int64_t DebugRecorder::getDroppedCount() const {
+		return dropped.load();
+	}
+
+	bool DebugRecorder::isFailed() const {
+		return failed.load();
+	}
+
+	void DebugRecorder::write() {
+		cv::VideoWriter video;
+		cv::Mat composite;
+#ifdef CAMSHIFT_EXCEPTIONS
+		try {
+			writeQueued(video, composite);
+		} catch (std::exception&) {
+			failed = true;
+		}
+#else
+		writeQueued(video, composite); // without exceptions, an error raised inside OpenCV ends the program
+#endif
+
+		/* Once recording has failed, record() refuses every frame, so the frames still queued are simply abandoned */
+		video.release();
+	}
+
+	void DebugRecorder::writeQueued(cv::VideoWriter& video, cv::Mat& composite) {
+		for (;;) {
+			uint64_t next = tail.load(std::memory_order_relaxed);
+			if (next == head.load(std::memory_order_acquire)) {
+				if (stopping)
+					return;
+
+				/* record() notifies without the lock, so a missed wake-up only delays the frame until the timeout */
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				wake.wait_for(lock, std::chrono::milliseconds(10));
+				continue;
+			}
+
+			Entry& entry = entries[next % entries.size()];
+			compose(entry, composite);
+			if (!video.isOpened() && !video.open(path, CV_FOURCC('M', 'J', 'P', 'G'), fps, composite.size(), true)) {
+				failed = true;
+				return;
+			}
+			video.write(composite);
+			tail.store(next + 1, std::memory_order_release);
+			recorded++;
+		}
+	}
+
+	void DebugRecorder::compose(Entry& entry, cv::Mat& composite) {
+		if (composite.empty())
+			composite.create(entry.capturedRawFrame.rows, 2 * entry.capturedRawFrame.cols, CV_8UC3);
+		cv::Size size(composite.cols / 2, composite.rows);
+		cv::Mat left(composite, cv::Rect(0, 0, size.width, size.height));
+		cv::Mat right(composite, cv::Rect(size.width, 0, size.width, size.height));
+
+		/* The entry is the writer's until tail moves past it, so it is annotated in place */
+		std::ostringstream sequence;
+		sequence << entry.sequence;
+		cv::ellipse(entry.capturedRawFrame, entry.rotatedTrack, cv::Scalar(0, 255, 0), 2);
+		cv::putText(entry.capturedRawFrame, sequence.str(), cv::Point(8, 24), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 255), 2);
+		cv::Mat backprojection;
+		cv::cvtColor(entry.backprojection, backprojection, cv::COLOR_GRAY2BGR);
+		if (entry.capturedRawFrame.size() == size) {
+			entry.capturedRawFrame.copyTo(left);
+			backprojection.copyTo(right);
+		} else {
+			cv::resize(entry.capturedRawFrame, left, size);
+			cv::resize(backprojection, right, size);
+		}
+	}
+};
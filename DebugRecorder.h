@@ -0,0 +1,122 @@
+/** \author Andrew Powell \date August 23rd, 2014 */
+
+#ifndef DEBUG_RECORDER_H_
+#define DEBUG_RECORDER_H_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+
+namespace camShift {
+
+	/**
+	 * \brief Records the tracker's frames and backprojections to a video without slowing the tracker
+	 *
+	 * Encoding and writing a video on the tracking thread costs several times the frame time of the
+	 * tracker itself. Instead, record() copies the captured raw frame, the backprojection and the rotated
+	 * track into a bounded queue of preallocated entries, and a background thread encodes them. Each
+	 * frame of the video shows the captured raw frame, annotated with the rotated track and the frame's
+	 * sequence number, beside the backprojection. If the queue is full, record() drops the frame and
+	 * counts it rather than waiting, so the tracker never blocks on the disk.
+	 *
+	 * A DebugRecorder is attached to a tracker with CamShift::setRecorder(), and can be attached and
+	 * detached at runtime. The video has the size of the first recorded frame, and later frames of
+	 * another size are scaled to it.
+	 *
+	 * \warning Only one thread may call record(), so trackers that share a DebugRecorder must run on the
+	 * same thread.
+	 * \author Andrew Powell
+	 * \date August 23rd, 2014
+	 */
+	class DebugRecorder {
+	public:
+
+		/**
+		 * \brief Constructor, which starts the background thread
+		 * \param path The path of the video, which is encoded as Motion JPEG
+		 * \param fps The frame rate stored in the video
+		 * \param capacity The number of frames the queue holds before frames are dropped
+		 */
+		DebugRecorder(const std::string& path, double fps, int capacity);
+
+		/** \brief Destructor, which writes every queued frame and closes the video */
+		~DebugRecorder();
+
+		/**
+		 * \brief Queues one frame for recording
+		 * \param capturedRawFrame The frame the tracker processed
+		 * \param backprojection The frame's backprojection
+		 * \param rotatedTrack The frame's rotated track
+		 * \param sequence The frame's sequence number
+		 * \return Returns false if the frame was dropped because the queue was full or recording has failed
+		 */
+		bool record(const cv::Mat& capturedRawFrame, const cv::Mat& backprojection, const cv::RotatedRect& rotatedTrack, int64_t sequence);
+
+		/**
+		 * \brief Gets the number of frames written to the video
+		 * \return Returns the number of frames written
+		 */
+		int64_t getRecordedCount() const;
+
+		/**
+		 * \brief Gets the number of frames record() queued
+		 *
+		 * Every queued frame is eventually written, unless recording fails first, in which case the queued
+		 * frames not yet written are discarded without being counted as dropped.
+		 *
+		 * \return Returns the number of frames queued
+		 */
+		int64_t getQueuedCount() const;
+
+		/**
+		 * \brief Gets the number of frames record() dropped rather than queued
+		 * \return Returns the number of frames dropped
+		 */
+		int64_t getDroppedCount() const;
+
+		/**
+		 * \brief Gets whether the video could not be opened or written, in which case record() drops every
+		 * later frame
+		 * \return Returns true if recording has failed
+		 */
+		bool isFailed() const;
+
+	private:
+		struct Entry {
+			cv::Mat capturedRawFrame;
+			cv::Mat backprojection;
+			cv::RotatedRect rotatedTrack;
+			int64_t sequence;
+		};
+
+		std::string path;
+		double fps;
+		std::vector<Entry> entries;
+		std::atomic<uint64_t> head;
+		std::atomic<uint64_t> tail;
+		std::atomic<int64_t> queued;
+		std::atomic<int64_t> recorded;
+		std::atomic<int64_t> dropped;
+		std::atomic<bool> failed;
+		std::atomic<bool> stopping;
+		std::mutex wakeMutex;
+		std::condition_variable wake;
+		std::thread writer;
+
+		void write();
+		void writeQueued(cv::VideoWriter& video, cv::Mat& composite);
+		static void compose(Entry& entry, cv::Mat& composite);
+
+		DebugRecorder(const DebugRecorder&);
+		DebugRecorder& operator=(const DebugRecorder&);
+	};
+};
+
+#endif
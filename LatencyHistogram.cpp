@@ -0,0 +1,152 @@
+/** \author Andrew Powell \date July 26th, 2014 */
+
+#include "LatencyHistogram.h"
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <ctime>
+
+namespace camShift {
+
+	LatencyHistogram::LatencyHistogram() {
+		reset();
+	}
+
+	LatencyHistogram::~LatencyHistogram() { }
+
+	int64_t LatencyHistogram::now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	int64_t LatencyHistogram::threadCpuNow() {
+		timespec time;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+			return 0;
+		return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+	}
+
+	void LatencyHistogram::record(int64_t nanoseconds) {
+		if (nanoseconds < 0)
+			nanoseconds = 0;
+		counts[getBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+		int64_t seen = minimum.load(std::memory_order_relaxed);
+		while (nanoseconds < seen && !minimum.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) { }
+		seen = maximum.load(std::memory_order_relaxed);
+		while (nanoseconds > seen && !maximum.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) { }
+	}
+
+	void LatencyHistogram::add(const LatencyHistogram& other) {
+		for (int i = 0; i < BUCKETS; i++) {
+			uint64_t otherCount = other.counts[i].load(std::memory_order_relaxed);
+			if (otherCount > 0)
+				counts[i].fetch_add(otherCount, std::memory_order_relaxed);
+		}
+		count.fetch_add(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		int64_t otherMinimum = other.minimum.load(std::memory_order_relaxed);
+		int64_t seen = minimum.load(std::memory_order_relaxed);
+		while (otherMinimum < seen && !minimum.compare_exchange_weak(seen, otherMinimum, std::memory_order_relaxed)) { }
+		int64_t otherMaximum = other.maximum.load(std::memory_order_relaxed);
+		seen = maximum.load(std::memory_order_relaxed);
+		while (otherMaximum > seen && !maximum.compare_exchange_weak(seen, otherMaximum, std::memory_order_relaxed)) { }
+	}
+
+	void LatencyHistogram::reset() {
+		for (int i = 0; i < BUCKETS; i++)
+			counts[i].store(0, std::memory_order_relaxed);
+		count.store(0, std::memory_order_relaxed);
+		sum.store(0, std::memory_order_relaxed);
+		minimum.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+		maximum.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t LatencyHistogram::getCount() const {
+		return count.load(std::memory_order_relaxed);
+	}
+
+	int64_t LatencyHistogram::getPercentile(double percentile) const {
+		uint64_t total = 0;
+		for (int i = 0; i < BUCKETS; i++)
+			total += counts[i].load(std::memory_order_relaxed);
+		if (total == 0)
+			return 0;
+		uint64_t rank = (uint64_t)(percentile / 100 * total + 0.5);
+		if (rank < 1)
+			rank = 1;
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKETS; i++) {
+			seen += counts[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+				return std::min(getHighestEquivalent(i), maximum.load(std::memory_order_relaxed));
+		}
+		return maximum.load(std::memory_order_relaxed);
+	}
+
+	std::string LatencyHistogram::toText() const {
+		uint64_t total = getCount();
+		std::ostringstream text;
+		text << std::fixed << std::setprecision(1)
+			<< "count=" << total
+			<< " mean=" << (total > 0 ? sum.load(std::memory_order_relaxed) / 1e3 / total : 0) << "us"
+			<< " p50=" << getPercentile(50) / 1e3 << "us"
+			<< " p90=" << getPercentile(90) / 1e3 << "us"
+			<< " p99=" << getPercentile(99) / 1e3 << "us"
+			<< " p99.9=" << getPercentile(99.9) / 1e3 << "us"
+			<< " p99.99=" << getPercentile(99.99) / 1e3 << "us"
+			<< " max=" << (total > 0 ? maximum.load(std::memory_order_relaxed) : 0) / 1e3 << "us";
+		return text.str();
+	}
+
+	std::string LatencyHistogram::toJson() const {
+		uint64_t total = getCount();
+		std::ostringstream json;
+		json << "{\"count\":" << total
+			<< ",\"min\":" << (total > 0 ? minimum.load(std::memory_order_relaxed) : 0)
+			<< ",\"max\":" << (total > 0 ? maximum.load(std::memory_order_relaxed) : 0)
+			<< ",\"mean\":" << (total > 0 ? sum.load(std::memory_order_relaxed) / (int64_t)total : 0)
+			<< ",\"percentiles\":{"
+			<< "\"50\":" << getPercentile(50)
+			<< ",\"90\":" << getPercentile(90)
+			<< ",\"99\":" << getPercentile(99)
+			<< ",\"99.9\":" << getPercentile(99.9)
+			<< ",\"99.99\":" << getPercentile(99.99)
+			<< "},\"buckets\":[";
+		bool first = true;
+		for (int i = 0; i < BUCKETS; i++) {
+			uint64_t bucketCount = counts[i].load(std::memory_order_relaxed);
+			if (bucketCount == 0)
+				continue;
+			json << (first ? "" : ",") << "[" << getHighestEquivalent(i) << "," << bucketCount << "]";
+			first = false;
+		}
+		json << "]}";
+		return json.str();
+	}
+
+	int LatencyHistogram::getBucket(int64_t nanoseconds) {
+		if (nanoseconds < SUB_BUCKETS)
+			return (int)nanoseconds;
+		if (nanoseconds >= ((int64_t)1 << MAX_BITS))
+			return BUCKETS - 1;
+		int highestBit = 0;
+		for (int64_t rest = nanoseconds >> 1; rest > 0; rest >>= 1)
+			highestBit++;
+
+		/* Group g covers [64 << (g - 1), 64 << g) with 64 buckets, each 1 << (g - 1) wide */
+		int group = highestBit - SUB_BUCKET_BITS + 1;
+		return (group - 1) * SUB_BUCKETS + (int)(nanoseconds >> (group - 1));
+	}
+
+	int64_t LatencyHistogram::getHighestEquivalent(int bucket) {
+		if (bucket < SUB_BUCKETS)
+			return bucket;
+		int group = bucket / SUB_BUCKETS;
+		int64_t subBucket = bucket - (group - 1) * SUB_BUCKETS;
+		return ((subBucket + 1) << (group - 1)) - 1;
+	}
+};
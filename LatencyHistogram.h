@@ -0,0 +1,119 @@
+/** \author Andrew Powell \date July 26th, 2014 */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+
+namespace camShift {
+
+	/**
+	 * \brief Records latencies into a high dynamic range histogram
+	 *
+	 * The LatencyHistogram class follows the layout of an HDR histogram. Latencies below 64 nanoseconds
+	 * each have their own bucket. Above that, each power of two is split into 64 buckets of equal width,
+	 * so every latency from 64 nanoseconds to about 18 minutes is recorded with a relative error of at
+	 * most 1/64 (about 1.6%), in a fixed table of counters. Percentiles far into the tail, such as the
+	 * 99.9th, can then be read without storing any individual latency.
+	 *
+	 * Recording is lock-free: every counter is atomic, so one thread may record while another reads, and
+	 * histograms of several trackers may be merged with add(). The histogram can be exported as text or
+	 * as JSON.
+	 *
+	 * \author Andrew Powell
+	 * \date July 26th, 2014
+	 */
+	class LatencyHistogram {
+	public:
+
+		/** \brief Constructor */
+		LatencyHistogram();
+
+		/** \brief Destructor */
+		~LatencyHistogram();
+
+		/**
+		 * \brief Gets the current time of a monotonic clock
+		 * \return Returns the time in nanoseconds since an unspecified point
+		 */
+		static int64_t now();
+
+		/**
+		 * \brief Gets the CPU time the calling thread has consumed, which excludes any time it was preempted
+		 * or waiting
+		 * \return Returns the time in nanoseconds since the thread started
+		 */
+		static int64_t threadCpuNow();
+
+		/**
+		 * \brief Records one latency
+		 * \param nanoseconds The latency, which is clamped to the histogram's range
+		 */
+		void record(int64_t nanoseconds);
+
+		/**
+		 * \brief Adds every latency recorded by another histogram to this one
+		 * \param other A reference to the histogram to merge
+		 */
+		void add(const LatencyHistogram& other);
+
+		/** \brief Removes every recorded latency */
+		void reset();
+
+		/**
+		 * \brief Gets the number of recorded latencies
+		 * \return Returns the number of recorded latencies
+		 */
+		uint64_t getCount() const;
+
+		/**
+		 * \brief Gets the latency below which a given fraction of the recorded latencies lie
+		 * \param percentile The percentile, from 0 to 100 (e.g. 99.9)
+		 * \return Returns the highest latency equivalent to the percentile's bucket, in nanoseconds, or 0
+		 * if nothing has been recorded
+		 */
+		int64_t getPercentile(double percentile) const;
+
+		/**
+		 * \brief Exports the histogram as text
+		 * \return Returns a line with the count, mean, common percentiles and maximum, in microseconds
+		 */
+		std::string toText() const;
+
+		/**
+		 * \brief Exports the histogram as JSON
+		 *
+		 * The JSON object holds the count, minimum, maximum, mean and common percentiles, and every
+		 * non-empty bucket as a pair of its highest equivalent latency and its count, so that exported
+		 * histograms can be merged elsewhere. Every latency is in nanoseconds.
+		 *
+		 * \return Returns the JSON object
+		 */
+		std::string toJson() const;
+
+	private:
+		enum {
+			SUB_BUCKET_BITS = 6,
+			SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+			MAX_BITS = 40,
+			BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 2) * SUB_BUCKETS
+		};
+
+		std::atomic<uint64_t> counts[BUCKETS];
+		std::atomic<uint64_t> count;
+		std::atomic<int64_t> sum;
+		std::atomic<int64_t> minimum;
+		std::atomic<int64_t> maximum;
+
+		static int getBucket(int64_t nanoseconds);
+		static int64_t getHighestEquivalent(int bucket);
+
+		LatencyHistogram(const LatencyHistogram&);
+		LatencyHistogram& operator=(const LatencyHistogram&);
+	};
+};
+
+#endif
@@ -0,0 +1,143 @@
+/** \author Andrew Powell \date July 12th, 2014 */
+
+#include "MultiCamShift.h"
+#include "DebugRecorder.h"
+#include <algorithm>
+
+namespace camShift {
+
+	MultiCamShift::MultiCamShift() { }
+
+	MultiCamShift::~MultiCamShift() { }
+
+	void MultiCamShift::addCamShift(CamShift& camShift) {
+		camShifts.push_back(&camShift);
+		weightsCounts.clear(); // forces the combined table to be rebuilt
+	}
+
+	void MultiCamShift::setCapturedRawFrame(cv::Mat& capturedRawFrame) {
+		this->capturedRawFrame = capturedRawFrame;
+		for (size_t i = 0; i < camShifts.size(); i++)
+			camShifts[i]->setCapturedRawFrame(capturedRawFrame);
+	}
+
+	void MultiCamShift::setCapturedRawFrame(cv::Mat& capturedRawFrame, int64_t captureTime, int64_t sequence) {
+		this->capturedRawFrame = capturedRawFrame;
+		for (size_t i = 0; i < camShifts.size(); i++)
+			camShifts[i]->setCapturedRawFrame(capturedRawFrame, captureTime, sequence);
+	}
+
+#ifdef CAMSHIFT_EXCEPTIONS
+	void MultiCamShift::runCamShift() {
+		CamShift::throwStatus(checkTargets());
+		processFrame();
+	}
+#endif
+
+	CamShift::Status MultiCamShift::tryRunCamShift() noexcept {
+		CamShift::Status status = checkTargets();
+		if (status != CamShift::OK)
+			return status;
+		return CamShift::guard([&]() { processFrame(); });
+	}
+
+	CamShift::Status MultiCamShift::checkTargets() const noexcept {
+		if (capturedRawFrame.rows == 0 || capturedRawFrame.cols == 0)
+			return CamShift::FRAME_NOT_SET;
+		if (camShifts.empty())
+			return CamShift::NO_TARGETS;
+		const CamShift& first = *camShifts[0];
+		for (size_t i = 0; i < camShifts.size(); i++) {
+			const CamShift& camShift = *camShifts[i];
+			if (camShift.histoFrame.empty())
+				return CamShift::SELECTION_NOT_SET;
+			if (camShift.lowMemory || camShift.planarHsv)
+				return CamShift::UNSUPPORTED_PARAMETER; // the shared pass converts and backprojects the whole interleaved frame
+			if (camShift.colorSpace != first.colorSpace)
+				return CamShift::INCOMPATIBLE_HISTOGRAMS;
+			for (int c = 0; c < CamShift::CHANNELS; c++) {
+				if (camShift.histoFrame.size[c] != first.histoFrame.size[c])
+					return CamShift::INCOMPATIBLE_HISTOGRAMS;
+			}
+		}
+		return CamShift::OK;
+	}
+
+	void MultiCamShift::processFrame() {
+		int64_t sharedStart = LatencyHistogram::now();
+		int64_t sharedCpuStart = LatencyHistogram::threadCpuNow();
+		size_t targets = camShifts.size();
+		for (size_t i = 0; i < targets; i++) {
+			if (i >= weightsCounts.size() || weightsCounts[i] != camShifts[i]->weightsCount) {
+				setWeights();
+				break;
+			}
+		}
+
+		/* The shared stages are sampled into the first CamShift object's counters, since they run once for all */
+		CamShift& first = *camShifts[0];
+		{
+			PerfCounters::Scope scope(first.perfCounters, PerfCounters::CONVERT);
+			ColorSpace::convert(first.colorSpace, capturedRawFrame, hsvFrame);
+		}
+
+		/* Each target's backprojection is written straight into its CamShift object's back buffer */
+		std::vector<uchar*> outputs(targets);
+		for (size_t i = 0; i < targets; i++)
+			camShifts[i]->claimBackBuffer(capturedRawFrame.size());
+
+		/* Every histogram has the same bins, so the first CamShift object's lookup tables serve all of them */
+		{
+			PerfCounters::Scope scope(first.perfCounters, PerfCounters::BACKPROJECT);
+			const int* hues = first.binTables[CamShift::HUE];
+			const int* sats = first.binTables[CamShift::SAT];
+			const int* vals = first.binTables[CamShift::VAL];
+			for (int y = 0; y < hsvFrame.rows; y++) {
+				const uchar* hsv = hsvFrame.ptr<uchar>(y);
+				for (size_t i = 0; i < targets; i++)
+					outputs[i] = camShifts[i]->backProjectionFrame.ptr<uchar>(y);
+				for (int x = 0; x < hsvFrame.cols; x++, hsv += 3) {
+					int bin = hues[hsv[0]] + sats[hsv[1]] + vals[hsv[2]];
+					if (bin < CamShift::OUT_OF_RANGE) {
+						const uchar* binWeights = &weights[bin * targets];
+						for (size_t i = 0; i < targets; i++)
+							outputs[i][x] = binWeights[i];
+					} else {
+						for (size_t i = 0; i < targets; i++)
+							outputs[i][x] = 0;
+					}
+				}
+			}
+		}
+
+		/* Each target is charged the shared pass and its own stages, but not the stages of the targets before it */
+		int64_t sharedTime = LatencyHistogram::now() - sharedStart;
+		int64_t sharedCpuTime = LatencyHistogram::threadCpuNow() - sharedCpuStart;
+		for (size_t i = 0; i < targets; i++) {
+			CamShift& camShift = *camShifts[i];
+			int64_t cpuStart = camShift.dutyCycle > 0 ? LatencyHistogram::threadCpuNow() : 0;
+			camShift.frameTimes.startTime = LatencyHistogram::now() - sharedTime;
+			camShift.filterBackprojection(camShift.backProjectionFrame);
+			camShift.trackBackprojection();
+			camShift.publishTrackState(false);
+			if (camShift.dutyCycle > 0)
+				camShift.countFrame(false, sharedCpuTime + LatencyHistogram::threadCpuNow() - cpuStart);
+			if (camShift.recorder != NULL)
+				camShift.recorder->record(capturedRawFrame, camShift.backProjectionFrame, camShift.trackRotated, camShift.frameTimes.sequence);
+		}
+	}
+
+	void MultiCamShift::setWeights() {
+		/* checkTargets() found the bins alike, so the weights of every target for one bin are stored together */
+		size_t targets = camShifts.size();
+		int binCount = camShifts[0]->binCount;
+		weights.resize(binCount * targets);
+		weightsCounts.resize(targets);
+		for (size_t i = 0; i < targets; i++) {
+			const std::vector<uchar>& binWeights = camShifts[i]->binWeights;
+			for (int bin = 0; bin < binCount; bin++)
+				weights[bin * targets + i] = binWeights[bin];
+			weightsCounts[i] = camShifts[i]->weightsCount;
+		}
+	}
+};
@@ -0,0 +1,108 @@
+/** \author Andrew Powell \date July 12th, 2014 */
+
+#ifndef MULTI_CAM_SHIFT_H_
+#define MULTI_CAM_SHIFT_H_
+
+#include <vector>
+#include "CamShift.h"
+
+
+namespace camShift {
+
+	/**
+	 * \brief Runs several CamShift objects over the same frames with a single backprojection pass
+	 *
+	 * When several targets are tracked in the same frame, each CamShift object would convert the frame to
+	 * HSV and backproject it on its own, reading the whole frame once per target. The MultiCamShift class
+	 * instead converts each frame once and combines the histograms of all its CamShift objects into one
+	 * table, in which the weights of every target for a given bin are stored next to each other. A single
+	 * pass over the HSV frame then looks up each pixel's bin once and writes every target's backprojection
+	 * directly into that target's CamShift object, so the frame is read only once however many targets
+	 * there are. Each CamShift object then filters its own backprojection, runs the CAMShift algorithm
+	 * and publishes its results as usual.
+	 *
+	 * The backprojections are identical to those produced by each CamShift object's own runCamShift().
+	 * Every CamShift object must use the same bins and CamShift::COLOR_SPACE_C, and none may set 
+	 * CamShift::LOW_MEMORY_C or CamShift::PLANAR_HSV_C, since the shared pass always converts and 
+	 * backprojects the whole interleaved frame. Every frame is processed, and counted as processed when
+	 * CamShift::DUTY_CYCLE_C is set.
+	 *
+	 * Each CamShift object's frame times span the shared pass and its own stages, but not those of the
+	 * objects before it. The shared conversion and backprojection are sampled into the first CamShift 
+	 * object's performance counters, and each object's own stages into its own.
+	 *
+	 * \author Andrew Powell
+	 * \date July 12th, 2014
+	 */
+	class MultiCamShift {
+	public:
+
+		/** \brief Constructor */
+		MultiCamShift();
+
+		/** \brief Destructor */
+		~MultiCamShift();
+
+		/**
+		 * \brief Adds a CamShift object whose target is tracked in the shared frames
+		 * \param camShift A reference to the CamShift object, which must outlive the MultiCamShift object
+		 */
+		void addCamShift(CamShift& camShift);
+
+		/**
+		 * \brief Sets the captured raw frame of every CamShift object
+		 * \param capturedRawFrame A reference to the image over which the CAMShift algorithm is executed
+		 */
+		void setCapturedRawFrame(cv::Mat& capturedRawFrame);
+
+		/**
+		 * \brief Sets the captured raw frame of every CamShift object, along with its sequence number and 
+		 * capture time
+		 * \param capturedRawFrame A reference to the image over which the CAMShift algorithm is executed
+		 * \param captureTime The time at which the frame was captured, from LatencyHistogram::now(), or 0
+		 * if unknown
+		 * \param sequence The frame's sequence number
+		 */
+		void setCapturedRawFrame(cv::Mat& capturedRawFrame, int64_t captureTime, int64_t sequence);
+
+#ifdef CAMSHIFT_EXCEPTIONS
+		/**
+		 * \brief Executes the CAMShift algorithm for every CamShift object
+		 *
+		 * The combined table is rebuilt whenever a CamShift object's weights have changed, as they do with
+		 * a new selection, a restore() or a change of FIXED_POINT_C.
+		 *
+		 * \throw runtime_error A runtime error is thrown if the captured raw frame has not been set, if no
+		 * CamShift object has been added, if a CamShift object's selection has not been set or it sets 
+		 * LOW_MEMORY_C or PLANAR_HSV_C, or if the CamShift objects' histograms have different bins or 
+		 * color spaces. See tryRunCamShift().
+		 */
+		void runCamShift();
+#endif
+
+		/**
+		 * \brief Executes the CAMShift algorithm for every CamShift object without throwing
+		 *
+		 * The noexcept counterpart of runCamShift(), and the only one declared when compiled without 
+		 * exceptions. The results are read from each CamShift object's getTrackState().
+		 *
+		 * \return Returns OK, FRAME_NOT_SET, NO_TARGETS, SELECTION_NOT_SET, UNSUPPORTED_PARAMETER, 
+		 * INCOMPATIBLE_HISTOGRAMS or OPENCV_FAILED, in which case no CamShift object is changed unless 
+		 * OpenCV failed part way
+		 */
+		CamShift::Status tryRunCamShift() noexcept;
+
+	private:
+		std::vector<CamShift*> camShifts;
+		std::vector<long> weightsCounts;
+		std::vector<uchar> weights;
+		cv::Mat capturedRawFrame;
+		cv::Mat hsvFrame;
+
+		CamShift::Status checkTargets() const noexcept;
+		void processFrame();
+		void setWeights();
+	};
+};
+
+#endif
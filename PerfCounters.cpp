@@ -0,0 +1,185 @@
+/** \author Andrew Powell \date August 2nd, 2014 */
+
+#include "PerfCounters.h"
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const char* stageNames[] = { "convert", "mask", "backproject", "threshold", "median blur", "erode", "dilate", "camshift" };
+	const char* counterNames[] = { "cycles", "instructions", "cache misses", "branch misses" };
+}
+
+namespace camShift {
+
+	PerfCounters::Scope::Scope(PerfCounters& perfCounters, Stage stage) :
+			perfCounters(perfCounters),
+			stage(stage),
+			sampling(false) {
+		if (perfCounters.enabled)
+			sampling = perfCounters.read(start);
+	}
+
+	PerfCounters::Scope::~Scope() {
+		uint64_t end[COUNTERS];
+		if (!sampling || !perfCounters.read(end))
+			return;
+		for (int i = 0; i < COUNTERS; i++)
+			perfCounters.totals[stage][i] += end[i] - start[i];
+		perfCounters.samples[stage]++;
+	}
+
+	PerfCounters::PerfCounters() :
+			enabled(false),
+			opened(false),
+			groupFd(CLOSED),
+			openCounters(0) {
+		for (int i = 0; i < COUNTERS; i++) {
+			fds[i] = CLOSED;
+			slots[i] = CLOSED;
+		}
+		reset();
+	}
+
+	PerfCounters::~PerfCounters() {
+		close();
+	}
+
+	void PerfCounters::setEnabled(bool enabled) {
+		this->enabled = enabled;
+		if (!enabled)
+			close();
+	}
+
+	bool PerfCounters::isEnabled() const {
+		return enabled;
+	}
+
+	bool PerfCounters::isAvailable() {
+		if (!enabled)
+			return false; // a disabled object never opens the counters
+		if (!opened)
+			open();
+		return openCounters > 0;
+	}
+
+	uint64_t PerfCounters::getTotal(Stage stage, Counter counter) const {
+		return totals[stage][counter];
+	}
+
+	uint64_t PerfCounters::getSamples(Stage stage) const {
+		return samples[stage];
+	}
+
+	void PerfCounters::reset() {
+		memset(totals, 0, sizeof(totals));
+		memset(samples, 0, sizeof(samples));
+	}
+
+	std::string PerfCounters::toText() {
+		std::ostringstream text;
+		if (!enabled) {
+			text << "hardware counters disabled" << std::endl;
+			return text.str();
+		}
+		if (!isAvailable()) {
+			text << "hardware counters unavailable" << std::endl;
+			return text.str();
+		}
+		text << std::left << std::setw(13) << "stage" << std::right << std::setw(9) << "samples";
+		for (int i = 0; i < COUNTERS; i++)
+			text << std::setw(15) << counterNames[i];
+		text << std::setw(7) << "IPC" << std::endl;
+		for (int stage = 0; stage < STAGES; stage++) {
+			if (samples[stage] == 0)
+				continue;
+			text << std::left << std::setw(13) << stageNames[stage] << std::right << std::setw(9) << samples[stage];
+			for (int i = 0; i < COUNTERS; i++) {
+				if (slots[i] == CLOSED)
+					text << std::setw(15) << "n/a";
+				else
+					text << std::setw(15) << totals[stage][i] / samples[stage];
+			}
+			if (slots[CYCLES] != CLOSED && slots[INSTRUCTIONS] != CLOSED && totals[stage][CYCLES] > 0)
+				text << std::setw(7) << std::fixed << std::setprecision(2) << (double)totals[stage][INSTRUCTIONS] / totals[stage][CYCLES];
+			text << std::endl;
+		}
+		return text.str();
+	}
+
+	void PerfCounters::open() {
+		opened = true;
+#ifdef __linux__
+		const uint64_t configs[COUNTERS] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+		for (int i = 0; i < COUNTERS; i++) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = groupFd == CLOSED ? 1 : 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+
+			/* Counts the calling thread on any CPU; the first counter opened leads the group */
+			int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+			if (fd < 0)
+				continue;
+			if (groupFd == CLOSED)
+				groupFd = fd;
+			fds[i] = fd;
+			slots[i] = openCounters++;
+		}
+		if (groupFd != CLOSED) {
+			ioctl(groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+	}
+
+	void PerfCounters::close() {
+#ifdef __linux__
+		for (int i = 0; i < COUNTERS; i++) {
+			if (fds[i] != CLOSED)
+				::close(fds[i]);
+		}
+#endif
+		for (int i = 0; i < COUNTERS; i++) {
+			fds[i] = CLOSED;
+			slots[i] = CLOSED;
+		}
+		groupFd = CLOSED;
+		openCounters = 0;
+		opened = false;
+	}
+
+	bool PerfCounters::read(uint64_t* values) {
+		if (!opened)
+			open();
+		if (openCounters == 0)
+			return false;
+#ifdef __linux__
+		uint64_t group[1 + COUNTERS];
+		if (::read(groupFd, group, sizeof(uint64_t) * (1 + openCounters)) <= 0)
+			return false;
+		for (int i = 0; i < COUNTERS; i++)
+			values[i] = slots[i] == CLOSED ? 0 : group[1 + slots[i]];
+		return true;
+#else
+		return false;
+#endif
+	}
+};
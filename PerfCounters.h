@@ -0,0 +1,135 @@
+/** \author Andrew Powell \date August 2nd, 2014 */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <string>
+#include <cstdint>
+
+
+namespace camShift {
+
+	/**
+	 * \brief Samples hardware performance counters around each stage of the CamShift pipeline
+	 *
+	 * On Linux, the PerfCounters class opens a group of hardware counters with perf_event_open: cycles,
+	 * instructions, cache misses and branch misses. Each stage of the pipeline is bracketed with a Scope,
+	 * which reads the group before and after the stage and adds the difference to that stage's totals.
+	 * The totals then show whether a stage, such as the backprojection or the dilation, is limited by
+	 * computation, by memory or by mispredicted branches.
+	 *
+	 * The counters are opened lazily by the first sample, and count only the thread that took it, in user
+	 * space. If the counters cannot be opened, as is common in containers and virtual machines or when
+	 * perf_event_paranoid forbids it, or on other operating systems, sampling does nothing and
+	 * isAvailable() returns false. A counter the hardware does not support is reported as unavailable
+	 * while the others are still collected.
+	 *
+	 * \author Andrew Powell
+	 * \date August 2nd, 2014
+	 */
+	class PerfCounters {
+	public:
+
+		/** \brief An enumerator type used to specify a stage of the pipeline */
+		enum Stage { CONVERT, MASK, BACKPROJECT, THRESHOLD, MEDIAN_BLUR, ERODE, DILATE, CAMSHIFT, STAGES };
+
+		/** \brief An enumerator type used to specify a hardware counter */
+		enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, COUNTERS };
+
+		/**
+		 * \brief Samples the counters for the lifetime of the Scope object
+		 *
+		 * A Scope does nothing if its PerfCounters object is disabled or the counters are unavailable.
+		 */
+		class Scope {
+		public:
+			/**
+			 * \brief Constructor, which starts a sample
+			 * \param perfCounters A reference to the PerfCounters object that accumulates the sample
+			 * \param stage Specifies the stage to which the sample is added
+			 */
+			Scope(PerfCounters& perfCounters, Stage stage);
+
+			/** \brief Destructor, which ends the sample */
+			~Scope();
+
+		private:
+			PerfCounters& perfCounters;
+			Stage stage;
+			bool sampling;
+			uint64_t start[COUNTERS];
+		};
+
+		/** \brief Constructor */
+		PerfCounters();
+
+		/** \brief Destructor */
+		~PerfCounters();
+
+		/**
+		 * \brief Enables or disables sampling
+		 * \param enabled Specifies whether stages are sampled
+		 */
+		void setEnabled(bool enabled);
+
+		/**
+		 * \brief Gets whether sampling is enabled
+		 * \return Returns true if sampling is enabled
+		 */
+		bool isEnabled() const;
+
+		/**
+		 * \brief Gets whether any counter could be opened
+		 * \return Returns true if at least one counter is being collected, and false without trying to
+		 * open the counters if sampling is disabled
+		 */
+		bool isAvailable();
+
+		/**
+		 * \brief Gets the total of a counter over every sample of a stage
+		 * \param stage Specifies the stage
+		 * \param counter Specifies the counter
+		 * \return Returns the total, or 0 if the counter is unavailable
+		 */
+		uint64_t getTotal(Stage stage, Counter counter) const;
+
+		/**
+		 * \brief Gets the number of samples of a stage
+		 * \param stage Specifies the stage
+		 * \return Returns the number of samples
+		 */
+		uint64_t getSamples(Stage stage) const;
+
+		/** \brief Clears every total */
+		void reset();
+
+		/**
+		 * \brief Exports the totals as text
+		 * \return Returns one line per sampled stage, with each counter's mean per sample, and the
+		 * instructions per cycle, or a single line if sampling is disabled, in which case the counters
+		 * are never opened
+		 */
+		std::string toText();
+
+	private:
+		enum { CLOSED = -1 };
+
+		bool enabled;
+		bool opened;
+		int groupFd;
+		int fds[COUNTERS];
+		int slots[COUNTERS];
+		int openCounters;
+		uint64_t totals[STAGES][COUNTERS];
+		uint64_t samples[STAGES];
+
+		void open();
+		void close();
+		bool read(uint64_t* values);
+
+		PerfCounters(const PerfCounters&);
+		PerfCounters& operator=(const PerfCounters&);
+	};
+};
+
+#endif
@@ -0,0 +1,138 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#include "TrackingClient.h"
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/memfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+namespace camShift {
+
+	TrackingClient::TrackingClient(const std::string& socketPath) :
+			frameData(NULL),
+			frameBytes(0) {
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (socketPath.size() >= sizeof(address.sun_path))
+			throw std::runtime_error("Socket path is too long");
+		strcpy(address.sun_path, socketPath.c_str());
+
+		clientSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (clientSocket < 0)
+			throw std::runtime_error(std::string("Failed to create socket: ") + strerror(errno));
+		if (connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) < 0) {
+			std::string error = strerror(errno);
+			close(clientSocket);
+			throw std::runtime_error("Failed to connect to daemon: " + error);
+		}
+		memset(&request, 0, sizeof(request));
+	}
+
+	TrackingClient::~TrackingClient() {
+		close(clientSocket);
+		releaseFrames();
+	}
+
+	int TrackingClient::createTarget() {
+		call(TrackingProtocol::CREATE_TARGET, -1);
+		return reply.target;
+	}
+
+	void TrackingClient::destroyTarget(int target) {
+		request.target = target;
+		call(TrackingProtocol::DESTROY_TARGET, -1);
+	}
+
+	void TrackingClient::setParameter(int target, int parameter, long newParameter) {
+		request.target = target;
+		request.parameter = parameter;
+		request.value = newParameter;
+		call(TrackingProtocol::SET_PARAMETER, -1);
+	}
+
+	long TrackingClient::getParameter(int target, int parameter) {
+		request.target = target;
+		request.parameter = parameter;
+		call(TrackingProtocol::GET_PARAMETER, -1);
+		return (long)reply.value;
+	}
+
+	unsigned char* TrackingClient::attachFrames(int width, int height) {
+		if (width <= 0 || height <= 0)
+			throw std::runtime_error("Invalid frame size");
+		releaseFrames();
+		size_t bytes = (size_t)width * height * 3;
+
+		/* The memory is sealed so that the daemon can trust its size */
+		int fd = (int)syscall(__NR_memfd_create, "camshift-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (fd < 0)
+			throw std::runtime_error(std::string("Failed to create frame memory: ") + strerror(errno));
+		void* data = MAP_FAILED;
+		if (ftruncate(fd, bytes) == 0 && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0)
+			data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			std::string error = strerror(errno);
+			close(fd);
+			throw std::runtime_error("Failed to create frame memory: " + error);
+		}
+		frameData = (unsigned char*)data;
+		frameBytes = bytes;
+
+		request.width = width;
+		request.height = height;
+		try {
+			call(TrackingProtocol::ATTACH_FRAMES, fd);
+		} catch (std::exception&) {
+			close(fd);
+			throw;
+		}
+		close(fd); // the daemon holds its own mapping
+		return frameData;
+	}
+
+	unsigned char* TrackingClient::getFrameData() {
+		return frameData;
+	}
+
+	void TrackingClient::setSelection(int target, int x, int y, int width, int height) {
+		request.target = target;
+		request.x = x;
+		request.y = y;
+		request.width = width;
+		request.height = height;
+		call(TrackingProtocol::SET_SELECTION, -1);
+	}
+
+	void TrackingClient::runFrame(int64_t sequence, int64_t captureTime, std::vector<TrackingProtocol::Result>& results) {
+		request.sequence = sequence;
+		request.captureTime = captureTime;
+		call(TrackingProtocol::RUN_FRAME, -1);
+		results.assign(reply.results, reply.results + reply.resultCount);
+	}
+
+	void TrackingClient::call(TrackingProtocol::Command command, int fd) {
+		request.command = command;
+		TrackingProtocol::send(clientSocket, &request, sizeof(request), fd);
+		size_t received = TrackingProtocol::receive(clientSocket, &reply, sizeof(reply), NULL);
+		if (received == 0)
+			throw std::runtime_error("Daemon has closed the connection");
+		if (received < TrackingProtocol::getReplySize(0) || received != TrackingProtocol::getReplySize(reply.resultCount))
+			throw std::runtime_error("Malformed reply");
+		if (reply.status != TrackingProtocol::OK)
+			throw std::runtime_error(reply.error);
+	}
+
+	void TrackingClient::releaseFrames() {
+		if (frameData != NULL)
+			munmap(frameData, frameBytes);
+		frameData = NULL;
+		frameBytes = 0;
+	}
+};
@@ -0,0 +1,130 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#ifndef TRACKING_CLIENT_H_
+#define TRACKING_CLIENT_H_
+
+#include <string>
+#include <vector>
+#include "TrackingProtocol.h"
+
+
+namespace camShift {
+
+	/**
+	 * \brief Tracks targets through a TrackingDaemon running in another process
+	 *
+	 * A TrackingClient connects to a TrackingDaemon's socket and drives CamShift objects hosted by the
+	 * daemon. After attachFrames(), each frame is written in BGR order into the shared memory returned by
+	 * getFrameData(), which the daemon reads in place, and runFrame() returns every target's results for
+	 * that frame. The TrackingClient class does not depend on OpenCV.
+	 *
+	 * Every method waits for the daemon's reply, so the shared memory may be rewritten as soon as
+	 * runFrame() or setSelection() returns. A TrackingClient should only be used by one thread at a time.
+	 *
+	 * \author Andrew Powell
+	 * \date August 9th, 2014
+	 */
+	class TrackingClient {
+	public:
+
+		/**
+		 * \brief Constructor, which connects to the daemon
+		 * \param socketPath The path of the daemon's Unix domain socket
+		 * \throw runtime_error A runtime error is thrown if the daemon cannot be reached.
+		 */
+		TrackingClient(const std::string& socketPath);
+
+		/** \brief Destructor, which disconnects from the daemon, destroying the client's targets */
+		~TrackingClient();
+
+		/**
+		 * \brief Creates a target, hosted by a new CamShift object
+		 * \return Returns the target's id
+		 * \throw runtime_error A runtime error is thrown if the request fails.
+		 */
+		int createTarget();
+
+		/**
+		 * \brief Destroys a target
+		 * \param target The target's id
+		 * \throw runtime_error A runtime error is thrown if the request fails.
+		 */
+		void destroyTarget(int target);
+
+		/**
+		 * \brief Sets one of a target's parameters
+		 * \param target The target's id
+		 * \param parameter One of CamShift's Parameter values
+		 * \param newParameter The parameter's new value
+		 * \throw runtime_error A runtime error is thrown if the request fails, with the error of
+		 * CamShift's setParameter().
+		 */
+		void setParameter(int target, int parameter, long newParameter);
+
+		/**
+		 * \brief Gets one of a target's parameters
+		 * \param target The target's id
+		 * \param parameter One of CamShift's Parameter values
+		 * \return Returns the parameter's value
+		 * \throw runtime_error A runtime error is thrown if the request fails.
+		 */
+		long getParameter(int target, int parameter);
+
+		/**
+		 * \brief Creates the shared memory that holds the frames, and passes it to the daemon
+		 *
+		 * Any previous shared memory is released.
+		 *
+		 * \param width The width of the frames in pixels
+		 * \param height The height of the frames in pixels
+		 * \return Returns a pointer to the shared memory. See getFrameData().
+		 * \throw runtime_error A runtime error is thrown if the memory cannot be created or the request fails.
+		 */
+		unsigned char* attachFrames(int width, int height);
+
+		/**
+		 * \brief Gets the shared memory that holds the frames
+		 * \return Returns a pointer to height rows of width * 3 bytes, in BGR order, or NULL if attachFrames()
+		 * has not been called
+		 */
+		unsigned char* getFrameData();
+
+		/**
+		 * \brief Sets a target's selection window over the frame in the shared memory
+		 * \param target The target's id
+		 * \param x The selection's left column
+		 * \param y The selection's top row
+		 * \param width The selection's width
+		 * \param height The selection's height
+		 * \throw runtime_error A runtime error is thrown if the request fails, with the error of
+		 * CamShift's setSelection().
+		 */
+		void setSelection(int target, int x, int y, int width, int height);
+
+		/**
+		 * \brief Runs every target over the frame in the shared memory
+		 * \param sequence The frame's sequence number
+		 * \param captureTime The frame's capture time from LatencyHistogram::now(), or 0 if unknown
+		 * \param results A reference to the vector that receives one result per target. A target that failed
+		 * to run, such as one without a selection, has a result whose status is not 0 (OK).
+		 * \throw runtime_error A runtime error is thrown if the request fails as a whole, such as when no
+		 * frames have been attached.
+		 */
+		void runFrame(int64_t sequence, int64_t captureTime, std::vector<TrackingProtocol::Result>& results);
+
+	private:
+		int clientSocket;
+		unsigned char* frameData;
+		size_t frameBytes;
+		TrackingProtocol::Request request;
+		TrackingProtocol::Reply reply;
+
+		void call(TrackingProtocol::Command command, int fd);
+		void releaseFrames();
+
+		TrackingClient(const TrackingClient&);
+		TrackingClient& operator=(const TrackingClient&);
+	};
+};
+
+#endif
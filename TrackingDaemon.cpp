@@ -0,0 +1,270 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#include "TrackingDaemon.h"
+#include <map>
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace camShift {
+
+	/* The targets and frame memory of one client */
+	struct TrackingDaemon::Session {
+		std::map<int, std::unique_ptr<CamShift> > targets;
+		int nextTarget;
+		void* frameData;
+		size_t frameBytes;
+		cv::Mat frame;
+
+		Session() : nextTarget(0), frameData(MAP_FAILED), frameBytes(0) { }
+
+		~Session() {
+			unmap();
+		}
+
+		void unmap() {
+			frame = cv::Mat();
+			if (frameData != MAP_FAILED)
+				munmap(frameData, frameBytes);
+			frameData = MAP_FAILED;
+			frameBytes = 0;
+		}
+
+		CamShift& getTarget(int target) {
+			std::map<int, std::unique_ptr<CamShift> >::iterator found = targets.find(target);
+			if (found == targets.end())
+				throw std::runtime_error("Target does not exist");
+			return *found->second;
+		}
+
+		cv::Mat& getFrame() {
+			if (frame.empty())
+				throw std::runtime_error("Frames have not been attached");
+			return frame;
+		}
+	};
+
+	TrackingDaemon::TrackingDaemon(const std::string& socketPath) :
+			socketPath(socketPath),
+			stopping(false) {
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (socketPath.size() >= sizeof(address.sun_path))
+			throw std::runtime_error("Socket path is too long");
+		strcpy(address.sun_path, socketPath.c_str());
+
+		listenSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (listenSocket < 0)
+			throw std::runtime_error(std::string("Failed to create socket: ") + strerror(errno));
+		unlink(socketPath.c_str());
+		if (bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenSocket, SOMAXCONN) < 0) {
+			std::string error = strerror(errno);
+			close(listenSocket);
+			throw std::runtime_error("Failed to listen on socket: " + error);
+		}
+	}
+
+	TrackingDaemon::~TrackingDaemon() {
+		stop();
+		reapClients(true);
+		close(listenSocket);
+		unlink(socketPath.c_str());
+	}
+
+	void TrackingDaemon::run() {
+		while (!stopping) {
+			int clientSocket = accept4(listenSocket, NULL, NULL, SOCK_CLOEXEC);
+			if (clientSocket < 0) {
+				if (stopping)
+					break;
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				std::string error = strerror(errno);
+				stop();
+				reapClients(true);
+				throw std::runtime_error("Failed to accept client: " + error);
+			}
+			reapClients(false);
+
+			std::lock_guard<std::mutex> lock(clientsMutex);
+			if (stopping) {
+				close(clientSocket);
+				break;
+			}
+			clients.push_back(Client());
+			Client& client = clients.back();
+			client.socket = clientSocket;
+			client.finished = false;
+			client.thread = std::thread(&TrackingDaemon::serve, this, std::ref(client));
+		}
+		reapClients(true);
+	}
+
+	void TrackingDaemon::stop() {
+		stopping = true;
+		shutdown(listenSocket, SHUT_RDWR); // wakes accept()
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		for (std::list<Client>::iterator client = clients.begin(); client != clients.end(); client++) {
+			if (!client->finished)
+				shutdown(client->socket, SHUT_RDWR); // wakes the client's thread
+		}
+	}
+
+	void TrackingDaemon::reapClients(bool all) {
+		std::list<Client> reaped;
+		{
+			std::lock_guard<std::mutex> lock(clientsMutex);
+			for (std::list<Client>::iterator client = clients.begin(); client != clients.end(); ) {
+				if (all || client->finished) {
+					if (!client->finished)
+						shutdown(client->socket, SHUT_RDWR);
+					reaped.splice(reaped.end(), clients, client++);
+				} else {
+					client++;
+				}
+			}
+		}
+		for (std::list<Client>::iterator client = reaped.begin(); client != reaped.end(); client++)
+			client->thread.join();
+	}
+
+	void TrackingDaemon::serve(Client& client) {
+		Session session;
+		TrackingProtocol::Request request;
+		TrackingProtocol::Reply reply;
+		try {
+			for (;;) {
+				int fd = -1;
+				size_t received = TrackingProtocol::receive(client.socket, &request, sizeof(request), &fd);
+				if (received == 0)
+					break;
+				reply.value = 0;
+				reply.status = TrackingProtocol::OK;
+				reply.target = request.target;
+				reply.resultCount = 0;
+				reply.error[0] = '\0';
+				try {
+					if (received != sizeof(request))
+						throw std::runtime_error("Malformed request");
+					handle(session, request, fd, reply);
+				} catch (std::exception& e) {
+					reply.status = TrackingProtocol::FAILED;
+					reply.resultCount = 0;
+					strncpy(reply.error, e.what(), TrackingProtocol::MAX_ERROR - 1);
+					reply.error[TrackingProtocol::MAX_ERROR - 1] = '\0';
+				}
+				if (fd >= 0)
+					close(fd); // a mapping outlives its descriptor
+				TrackingProtocol::send(client.socket, &reply, TrackingProtocol::getReplySize(reply.resultCount), -1);
+			}
+		} catch (std::exception&) {
+			/* The connection has failed, so the client is dropped along with its targets */
+		}
+
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		close(client.socket);
+		client.finished = true;
+	}
+
+	void TrackingDaemon::handle(Session& session, const TrackingProtocol::Request& request, int fd, TrackingProtocol::Reply& reply) {
+		if ((request.command == TrackingProtocol::SET_PARAMETER || request.command == TrackingProtocol::GET_PARAMETER) && 
+				(request.parameter < 0 || request.parameter >= CamShift::PARAMETERS))
+			throw std::runtime_error(CamShift::getStatusMessage(CamShift::INVALID_PARAMETER));
+
+		switch (request.command) {
+		case TrackingProtocol::CREATE_TARGET:
+			if (session.targets.size() >= TrackingProtocol::MAX_TARGETS)
+				throw std::runtime_error("Too many targets");
+			reply.target = session.nextTarget++;
+			session.targets[reply.target].reset(new CamShift());
+			break;
+		case TrackingProtocol::DESTROY_TARGET:
+			session.getTarget(request.target);
+			session.targets.erase(request.target);
+			break;
+		case TrackingProtocol::SET_PARAMETER:
+			session.getTarget(request.target).setParameter((CamShift::Parameter)request.parameter, (long)request.value);
+			break;
+		case TrackingProtocol::GET_PARAMETER:
+			reply.value = session.getTarget(request.target).getParameter((CamShift::Parameter)request.parameter);
+			break;
+		case TrackingProtocol::SET_SELECTION: {
+			CamShift& camShift = session.getTarget(request.target);
+			cv::Rect selection(request.x, request.y, request.width, request.height);
+			camShift.setCapturedRawFrame(session.getFrame());
+			camShift.setSelection(selection);
+			break;
+		}
+		case TrackingProtocol::ATTACH_FRAMES: {
+			if (fd < 0)
+				throw std::runtime_error("Frame memory was not passed");
+			if (request.width <= 0 || request.height <= 0)
+				throw std::runtime_error("Invalid frame size");
+			size_t frameBytes = (size_t)request.width * request.height * 3;
+
+			/* If the client could shrink the memory, reading a frame would raise SIGBUS in the daemon */
+			int seals = fcntl(fd, F_GET_SEALS);
+			if (seals < 0 || (seals & F_SEAL_SHRINK) == 0)
+				throw std::runtime_error("Frame memory must be a memfd sealed against shrinking");
+			struct stat status;
+			if (fstat(fd, &status) < 0 || (size_t)status.st_size < frameBytes)
+				throw std::runtime_error("Frame memory is smaller than the frame size");
+			void* frameData = mmap(NULL, frameBytes, PROT_READ, MAP_SHARED, fd, 0);
+			if (frameData == MAP_FAILED)
+				throw std::runtime_error(std::string("Failed to map frame memory: ") + strerror(errno));
+			session.unmap();
+			session.frameData = frameData;
+			session.frameBytes = frameBytes;
+			session.frame = cv::Mat(request.height, request.width, CV_8UC3, frameData);
+			break;
+		}
+		case TrackingProtocol::RUN_FRAME: {
+			cv::Mat& frame = session.getFrame();
+			std::map<int, std::unique_ptr<CamShift> >::iterator target;
+			for (target = session.targets.begin(); target != session.targets.end(); target++) {
+				CamShift& camShift = *target->second;
+				camShift.setCapturedRawFrame(frame, request.captureTime, request.sequence);
+
+				/* Each target reports its own failure, so one target without a selection cannot fail the rest */
+				TrackingProtocol::Result& result = reply.results[reply.resultCount++];
+				memset(&result, 0, sizeof(result));
+				result.target = target->first;
+				CamShift::TrackResult trackResult;
+				CamShift::Status status = camShift.tryRunCamShift(trackResult);
+				result.status = status;
+				if (status != CamShift::OK) {
+					result.sequence = request.sequence;
+					result.captureTime = request.captureTime;
+					continue;
+				}
+				const CamShift::FrameTimes& times = trackResult.times;
+				const cv::Rect& track = trackResult.track;
+				const cv::RotatedRect& rotatedTrack = trackResult.rotatedTrack;
+				result.sequence = times.sequence;
+				result.captureTime = times.captureTime;
+				result.startTime = times.startTime;
+				result.completionTime = times.completionTime;
+				result.x = track.x;
+				result.y = track.y;
+				result.width = track.width;
+				result.height = track.height;
+				result.centerX = rotatedTrack.center.x;
+				result.centerY = rotatedTrack.center.y;
+				result.rotatedWidth = rotatedTrack.size.width;
+				result.rotatedHeight = rotatedTrack.size.height;
+				result.angle = rotatedTrack.angle;
+			}
+			break;
+		}
+		default:
+			throw std::runtime_error("Unknown command");
+		}
+	}
+};
@@ -0,0 +1,85 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#ifndef TRACKING_DAEMON_H_
+#define TRACKING_DAEMON_H_
+
+#include <string>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "CamShift.h"
+#include "TrackingProtocol.h"
+
+
+namespace camShift {
+
+	/**
+	 * \brief Hosts CamShift objects on behalf of other processes
+	 *
+	 * Processes that need tracking need not link OpenCV or own CamShift objects themselves. Instead, they
+	 * connect to a TrackingDaemon through a TrackingClient over a Unix domain socket. Over that socket,
+	 * each client creates targets, sets their parameters and selections, and receives the results of every
+	 * frame. The frames themselves are written by the client into a memfd shared memory region that the
+	 * daemon maps once, so a frame is never copied between the processes. See TrackingProtocol.
+	 *
+	 * Each client is served by its own thread and owns its targets, so clients never wait on each other.
+	 * A request that fails, for instance because a parameter is invalid, is answered with the error rather
+	 * than ending the client's connection.
+	 *
+	 * The TrackingDaemon class is specific to Linux.
+	 *
+	 * \author Andrew Powell
+	 * \date August 9th, 2014
+	 */
+	class TrackingDaemon {
+	public:
+
+		/**
+		 * \brief Constructor, which creates the daemon's socket
+		 * \param socketPath The path of the Unix domain socket, which replaces any file at that path
+		 * \throw runtime_error A runtime error is thrown if the socket cannot be created.
+		 */
+		TrackingDaemon(const std::string& socketPath);
+
+		/** \brief Destructor, which stops the daemon and removes its socket */
+		~TrackingDaemon();
+
+		/**
+		 * \brief Accepts and serves clients until stop() is called
+		 * \throw runtime_error A runtime error is thrown if accepting a client fails.
+		 */
+		void run();
+
+		/**
+		 * \brief Stops the daemon, disconnecting every client
+		 *
+		 * stop() may be called from any thread, but not from a signal handler. run() returns once every
+		 * client's thread has finished.
+		 */
+		void stop();
+
+	private:
+		struct Session;
+		struct Client {
+			int socket;
+			bool finished;
+			std::thread thread;
+		};
+
+		std::string socketPath;
+		int listenSocket;
+		std::atomic<bool> stopping;
+		std::mutex clientsMutex;
+		std::list<Client> clients;
+
+		void serve(Client& client);
+		void handle(Session& session, const TrackingProtocol::Request& request, int fd, TrackingProtocol::Reply& reply);
+		void reapClients(bool all);
+
+		TrackingDaemon(const TrackingDaemon&);
+		TrackingDaemon& operator=(const TrackingDaemon&);
+	};
+};
+
+#endif
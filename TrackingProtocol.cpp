@@ -0,0 +1,99 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#include "TrackingProtocol.h"
+#include <stdexcept>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace camShift {
+
+	void TrackingProtocol::send(int socket, const void* message, size_t size, int fd) {
+		struct iovec data;
+		data.iov_base = const_cast<void*>(message);
+		data.iov_len = size;
+		struct msghdr header;
+		memset(&header, 0, sizeof(header));
+		header.msg_iov = &data;
+		header.msg_iovlen = 1;
+
+		/* The descriptor travels as SCM_RIGHTS ancillary data, so the receiver gets its own copy */
+		union {
+			struct cmsghdr alignment;
+			char buffer[CMSG_SPACE(sizeof(int))];
+		} control;
+		if (fd >= 0) {
+			memset(&control, 0, sizeof(control));
+			header.msg_control = control.buffer;
+			header.msg_controllen = sizeof(control.buffer);
+			struct cmsghdr* rights = CMSG_FIRSTHDR(&header);
+			rights->cmsg_level = SOL_SOCKET;
+			rights->cmsg_type = SCM_RIGHTS;
+			rights->cmsg_len = CMSG_LEN(sizeof(int));
+			memcpy(CMSG_DATA(rights), &fd, sizeof(int));
+		}
+
+		ssize_t sent;
+		do {
+			sent = sendmsg(socket, &header, MSG_NOSIGNAL);
+		} while (sent < 0 && errno == EINTR);
+		if (sent < 0)
+			throw std::runtime_error(std::string("Failed to send message: ") + strerror(errno));
+		if ((size_t)sent != size)
+			throw std::runtime_error("Failed to send the whole message");
+	}
+
+	size_t TrackingProtocol::receive(int socket, void* message, size_t size, int* fd) {
+		struct iovec data;
+		data.iov_base = message;
+		data.iov_len = size;
+		union {
+			struct cmsghdr alignment;
+			char buffer[CMSG_SPACE(sizeof(int))];
+		} control;
+		struct msghdr header;
+		memset(&header, 0, sizeof(header));
+		header.msg_iov = &data;
+		header.msg_iovlen = 1;
+		header.msg_control = control.buffer;
+		header.msg_controllen = sizeof(control.buffer);
+
+		ssize_t received;
+		do {
+			received = recvmsg(socket, &header, MSG_CMSG_CLOEXEC);
+		} while (received < 0 && errno == EINTR);
+		if (received < 0)
+			throw std::runtime_error(std::string("Failed to receive message: ") + strerror(errno));
+
+		/* Only the first descriptor is kept; any others a peer passed in the same message are closed, not leaked */
+		int passedFd = -1;
+		for (struct cmsghdr* rights = CMSG_FIRSTHDR(&header); rights != NULL; rights = CMSG_NXTHDR(&header, rights)) {
+			if (rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS)
+				continue;
+			size_t count = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (size_t i = 0; i < count; i++) {
+				int rightsFd;
+				memcpy(&rightsFd, CMSG_DATA(rights) + i * sizeof(int), sizeof(int));
+				if (passedFd < 0)
+					passedFd = rightsFd;
+				else
+					close(rightsFd);
+			}
+		}
+		if (fd != NULL)
+			*fd = passedFd;
+		else if (passedFd >= 0)
+			close(passedFd);
+		if (header.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+			if (fd != NULL && passedFd >= 0) {
+				close(passedFd);
+				*fd = -1;
+			}
+			throw std::runtime_error("Received message is too long");
+		}
+		return (size_t)received;
+	}
+};
@@ -0,0 +1,139 @@
+/** \author Andrew Powell \date August 9th, 2014 */
+
+#ifndef TRACKING_PROTOCOL_H_
+#define TRACKING_PROTOCOL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace camShift {
+
+	/**
+	 * \brief Defines the messages exchanged between a TrackingDaemon and its TrackingClient objects
+	 *
+	 * Every request and every reply is a single packet on a SOCK_SEQPACKET Unix domain socket, so messages
+	 * are never split or merged. Each request is answered by exactly one reply before the next request is
+	 * read. Frames are never copied through the socket: a client writes each frame into a memfd shared
+	 * memory region, whose descriptor it passes once with ATTACH_FRAMES, and then only names the frame with
+	 * RUN_FRAME.
+	 *
+	 * The TrackingProtocol header does not depend on OpenCV, so that clients need not link it.
+	 *
+	 * \author Andrew Powell
+	 * \date August 9th, 2014
+	 */
+	class TrackingProtocol {
+	public:
+
+		/**
+		 * \brief An enumerator type used to specify what a request asks of the daemon
+		 *
+		 * CREATE_TARGET creates a CamShift object and returns its id in the reply's target, and 
+		 * DESTROY_TARGET destroys it. SET_PARAMETER and GET_PARAMETER set and get one of the target's 
+		 * parameters. ATTACH_FRAMES maps the shared memory passed with the request, which holds frames of 
+		 * the request's size. SET_SELECTION sets the target's selection over the frame in the shared memory,
+		 * and RUN_FRAME runs every target of the client over it. A target that fails to run does not fail
+		 * RUN_FRAME; its failure is reported in its own result's status.
+		 */
+		enum Command { CREATE_TARGET, DESTROY_TARGET, SET_PARAMETER, GET_PARAMETER, SET_SELECTION, ATTACH_FRAMES, RUN_FRAME };
+
+		/** \brief An enumerator type used to specify whether a request succeeded */
+		enum Status { OK, FAILED };
+
+		/** \brief The maximum number of targets per client, and the length of an error message */
+		enum { MAX_TARGETS = 64, MAX_ERROR = 128 };
+
+		/** \brief A request from a client */
+		struct Request {
+			/** \brief The new value of the parameter, for SET_PARAMETER */
+			int64_t value;
+			/** \brief The frame's sequence number, for RUN_FRAME */
+			int64_t sequence;
+			/** \brief The frame's capture time from LatencyHistogram::now(), or 0, for RUN_FRAME */
+			int64_t captureTime;
+			/** \brief One of the Command values */
+			int32_t command;
+			/** \brief The target's id */
+			int32_t target;
+			/** \brief One of CamShift's Parameter values, for SET_PARAMETER and GET_PARAMETER */
+			int32_t parameter;
+			/** \brief The selection, for SET_SELECTION, or the frame size, for ATTACH_FRAMES */
+			int32_t x, y, width, height;
+		};
+
+		/** \brief The results of one target over one frame */
+		struct Result {
+			/** \brief The sequence number and times of the frame, as in CamShift::FrameTimes */
+			int64_t sequence, captureTime, startTime, completionTime;
+			/** \brief The target's id */
+			int32_t target;
+			/**
+			 * \brief One of CamShift's Status values, which CamShift::getStatusMessage() describes. Unless it is
+			 * 0 (OK), only the target, sequence and captureTime are set, and the rest of the result is zero.
+			 */
+			int32_t status;
+			/** \brief The track window */
+			int32_t x, y, width, height;
+			/** \brief The rotated track window */
+			float centerX, centerY, rotatedWidth, rotatedHeight, angle;
+		};
+
+		/**
+		 * \brief A reply from the daemon
+		 *
+		 * Only the first resultCount results are sent. See getReplySize().
+		 */
+		struct Reply {
+			/** \brief The reply's value, for GET_PARAMETER */
+			int64_t value;
+			/** \brief One of the Status values */
+			int32_t status;
+			/** \brief The created target's id, for CREATE_TARGET */
+			int32_t target;
+			/** \brief The number of results, for RUN_FRAME */
+			int32_t resultCount;
+			/** \brief The reason the request failed, if its status is FAILED */
+			char error[MAX_ERROR];
+			/** \brief The results of every target, for RUN_FRAME */
+			Result results[MAX_TARGETS];
+		};
+
+		/**
+		 * \brief Gets the number of bytes of a reply that are sent
+		 * \param resultCount The number of results in the reply
+		 * \return Returns the size of the reply without its unused results
+		 */
+		static size_t getReplySize(int resultCount) {
+			return offsetof(Reply, results) + resultCount * sizeof(Result);
+		}
+
+		/**
+		 * \brief Sends one message, along with a file descriptor
+		 * \param socket The socket over which the message is sent
+		 * \param message A pointer to the message
+		 * \param size The size of the message in bytes
+		 * \param fd The file descriptor to pass, or -1 if none
+		 * \throw runtime_error A runtime error is thrown if the message cannot be sent.
+		 */
+		static void send(int socket, const void* message, size_t size, int fd);
+
+		/**
+		 * \brief Receives one message, along with a file descriptor if one was passed
+		 * \param socket The socket from which the message is received
+		 * \param message A pointer to the buffer that receives the message
+		 * \param size The size of the buffer in bytes
+		 * \param fd A pointer that receives the passed file descriptor, or -1 if none was passed. If fd is
+		 * NULL, a passed file descriptor is closed.
+		 * \return Returns the size of the message in bytes, or 0 if the peer has closed the socket
+		 * \throw runtime_error A runtime error is thrown if the message cannot be received or is larger than
+		 * the buffer.
+		 */
+		static size_t receive(int socket, void* message, size_t size, int* fd);
+
+	private:
+		TrackingProtocol();
+	};
+};
+
+#endif
@@ -0,0 +1,91 @@
+/** \author Andrew Powell \date June 21st, 2014 */
+
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+
+#include <atomic>
+
+
+namespace camShift {
+
+	/**
+	 * \brief Hands values from one writer thread to one reader thread without locks
+	 *
+	 * The TripleBuffer class holds three slots. The writer owns the back slot, the reader owns the front
+	 * slot, and the middle slot holds the most recently published value. Publishing and acquiring each
+	 * exchange a single atomic index, so neither the writer nor the reader ever waits on the other and
+	 * neither ever observes a slot the other is modifying.
+	 *
+	 * Because the slots are reused rather than reallocated, a slot that holds a cv::Mat keeps its storage
+	 * from one round to the next.
+	 *
+	 * \warning Only one thread may call getBack() and publish(), and only one thread may call acquire()
+	 * and getFront().
+	 * \author Andrew Powell
+	 * \date June 21st, 2014
+	 */
+	template <typename T>
+	class TripleBuffer {
+	public:
+
+		/** \brief Constructor */
+		TripleBuffer() : back(0), middle(1), front(2) { }
+
+		/**
+		 * \brief Gets the slot the writer fills before calling publish()
+		 * \return Returns a reference to the back slot
+		 */
+		T& getBack() { return slots[back]; }
+
+		/** \brief Makes the back slot the newest value available to the reader */
+		void publish() {
+			back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+		}
+
+		/**
+		 * \brief Moves the newest published value, if any, into the front slot
+		 * \return Returns true if a value published since the last call was acquired
+		 */
+		bool acquire() {
+			if ((middle.load(std::memory_order_acquire) & FRESH) == 0)
+				return false;
+			front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+			return true;
+		}
+
+		/**
+		 * \brief Gets the slot the reader acquired last
+		 * \return Returns a reference to the front slot, which stays unchanged until the next acquire()
+		 */
+		const T& getFront() const { return slots[front]; }
+
+		/**
+		 * \brief Gets any of the three slots, for inspection by the writer
+		 * \param index Specifies the slot, from 0 to 2
+		 * \return Returns a reference to the slot
+		 * \warning The writer must not modify a slot through peek(), since the reader may hold it.
+		 */
+		const T& peek(int index) const { return slots[index]; }
+
+		/**
+		 * \brief Gets any of the three slots, for preparing them before the reader starts
+		 * \param index Specifies the slot, from 0 to 2
+		 * \return Returns a reference to the slot
+		 * \warning getSlot() must not be called once the reader may be calling acquire().
+		 */
+		T& getSlot(int index) { return slots[index]; }
+
+	private:
+		enum { INDEX = 3, FRESH = 4 };
+
+		T slots[3];
+		int back;
+		std::atomic<int> middle;
+		int front;
+
+		TripleBuffer(const TripleBuffer&);
+		TripleBuffer& operator=(const TripleBuffer&);
+	};
+};
+
+#endif
@@ -0,0 +1,261 @@
+/** \author Andrew Powell \date August 16th, 2014 */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <exception>
+#include "CamShift.h"
+#include "LatencyHistogram.h"
+
+using namespace camShift;
+using namespace std;
+
+/* One point in the parameter space */
+struct Settings {
+	int hueBins;
+	int satBins;
+	int valBins;
+	int medianBlur;
+	int threshold;
+	int backgroundRing;
+};
+
+/* The accuracy and cost of one point */
+struct Evaluation {
+	Settings settings;
+	bool failed;
+	double cost;
+	double iou;
+	double centerError;
+};
+
+/* The recorded clip, and the track of every frame against which the settings are scored */
+struct Clip {
+	vector<cv::Mat> frames;
+	vector<cv::Rect> tracks;
+};
+
+double getIou(const cv::Rect& a, const cv::Rect& b) {
+	double united = (a | b).area();
+	return united > 0 ? (a & b).area() / united : 1;
+}
+
+double getCenterError(const cv::Rect& a, const cv::Rect& b) {
+	double x = (a.x + a.width / 2.) - (b.x + b.width / 2.);
+	double y = (a.y + a.height / 2.) - (b.y + b.height / 2.);
+	return sqrt(x * x + y * y);
+}
+
+/* Replays the clip with the given settings, starting from the first frame's track */
+Evaluation evaluate(const Settings& settings, const Clip& clip) {
+	Evaluation evaluation;
+	evaluation.settings = settings;
+	evaluation.failed = false;
+	evaluation.cost = evaluation.iou = evaluation.centerError = 0;
+	try {
+		CamShift camShift;
+		camShift.setParameter(CamShift::HUE_BINS_C, settings.hueBins);
+		camShift.setParameter(CamShift::SAT_BINS_C, settings.satBins);
+		camShift.setParameter(CamShift::VAL_BINS_C, settings.valBins);
+		camShift.setParameter(CamShift::MEDIAN_BLUR_C, settings.medianBlur);
+		camShift.setParameter(CamShift::THRESHOLD_C, settings.threshold);
+		camShift.setParameter(CamShift::BACKGROUND_RING_C, settings.backgroundRing);
+		camShift.prepare(clip.frames[0].size(), CV_8UC3);
+
+		cv::Mat capturedRawFrame = clip.frames[0];
+		cv::Rect selection = clip.tracks[0];
+		camShift.setCapturedRawFrame(capturedRawFrame);
+		camShift.setSelection(selection);
+
+		vector<int64_t> costs;
+		for (size_t frame = 1; frame < clip.frames.size(); frame++) {
+			capturedRawFrame = clip.frames[frame];
+			int64_t start = LatencyHistogram::now();
+			camShift.setCapturedRawFrame(capturedRawFrame);
+			camShift.runCamShift();
+			costs.push_back(LatencyHistogram::now() - start);
+			evaluation.iou += getIou(camShift.getTrack(), clip.tracks[frame]);
+			evaluation.centerError += getCenterError(camShift.getTrack(), clip.tracks[frame]);
+		}
+		nth_element(costs.begin(), costs.begin() + costs.size() / 2, costs.end());
+		evaluation.cost = costs[costs.size() / 2] / 1e6;
+		evaluation.iou /= costs.size();
+		evaluation.centerError /= costs.size();
+
+	/* Settings under which the track is lost are not on any front */
+	} catch (exception&) {
+		evaluation.failed = true;
+	}
+	return evaluation;
+}
+
+/* Keeps the evaluations that no other evaluation beats in both cost and accuracy, from cheapest to dearest */
+vector<Evaluation> getParetoFront(vector<Evaluation> evaluations) {
+	sort(evaluations.begin(), evaluations.end(), [](const Evaluation& a, const Evaluation& b) {
+		return a.cost < b.cost || (a.cost == b.cost && a.iou > b.iou);
+	});
+	vector<Evaluation> front;
+	for (size_t i = 0; i < evaluations.size(); i++) {
+		if (!evaluations[i].failed && (front.empty() || evaluations[i].iou > front.back().iou))
+			front.push_back(evaluations[i]);
+	}
+	return front;
+}
+
+/* Reads one track per line, as "x y width height", skipping blank lines and lines starting with '#' */
+vector<cv::Rect> readTracks(const string& path) {
+	ifstream file(path.c_str());
+	if (!file)
+		throw runtime_error("Failed to open the track file " + path);
+	vector<cv::Rect> tracks;
+	string line;
+	while (getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		cv::Rect track;
+		istringstream fields(line);
+		if (!(fields >> track.x >> track.y >> track.width >> track.height))
+			throw runtime_error("Malformed track: " + line);
+		tracks.push_back(track);
+	}
+	return tracks;
+}
+
+int main(int argc, char* argv[]) {
+
+	/*
+	 * Instructions:
+	 *
+	 * The tuner searches the histogram bins, median blur, threshold and background ring of the CamShift
+	 * class for the settings that best trade accuracy against cost over a recorded clip. It is run as
+	 *
+	 *     Tuner <clip> <tracks> [samples] [frames]
+	 *
+	 * where tracks is either a file holding the ground truth track of every frame, one "x y width height"
+	 * per line, or the selection of the first frame as "x,y,width,height". In the latter case, the tracks
+	 * of the default settings serve as the reference. The first frame's track is the selection of every
+	 * run. The clip is decoded once into memory, up to the given number of frames.
+	 *
+	 * The given number of settings, the default settings first, are drawn at random and replayed over
+	 * the clip in parallel on every core. Accuracy is the mean intersection over union of each frame's
+	 * track with the reference, and cost is the median time per frame. The settings on the Pareto front,
+	 * those that no others beat in both accuracy and cost, are then timed again one at a time, so that
+	 * their costs are not inflated by the other cores, and printed from cheapest to dearest.
+	 */
+
+	try {
+		if (argc < 3)
+			throw runtime_error("Usage: Tuner <clip> <tracks file | x,y,width,height> [samples] [frames]");
+		int samples = argc > 3 ? atoi(argv[3]) : 200;
+		int maxFrames = argc > 4 ? atoi(argv[4]) : 300;
+
+		Clip clip;
+		cv::VideoCapture capture(argv[1]);
+		if (!capture.isOpened())
+			throw runtime_error(string("Failed to open the clip ") + argv[1]);
+		cv::Mat frame;
+		while ((int)clip.frames.size() < maxFrames && capture.read(frame))
+			clip.frames.push_back(frame.clone());
+
+		/* Default settings, whose tracks are the reference if there is no ground truth */
+		CamShift defaults;
+		Settings defaultSettings = {
+			(int)defaults.getParameter(CamShift::HUE_BINS_C),
+			(int)defaults.getParameter(CamShift::SAT_BINS_C),
+			(int)defaults.getParameter(CamShift::VAL_BINS_C),
+			(int)defaults.getParameter(CamShift::MEDIAN_BLUR_C),
+			(int)defaults.getParameter(CamShift::THRESHOLD_C),
+			(int)defaults.getParameter(CamShift::BACKGROUND_RING_C)
+		};
+		cv::Rect selection;
+		if (sscanf(argv[2], "%d,%d,%d,%d", &selection.x, &selection.y, &selection.width, &selection.height) == 4) {
+			if (clip.frames.empty())
+				throw runtime_error("The clip has no frames");
+			cv::Mat capturedRawFrame = clip.frames[0];
+			defaults.setCapturedRawFrame(capturedRawFrame);
+			defaults.setSelection(selection);
+			clip.tracks.push_back(selection);
+			for (size_t i = 1; i < clip.frames.size(); i++) {
+				capturedRawFrame = clip.frames[i];
+				defaults.setCapturedRawFrame(capturedRawFrame);
+				defaults.runCamShift();
+				clip.tracks.push_back(defaults.getTrack());
+			}
+		} else {
+			clip.tracks = readTracks(argv[2]);
+			if (clip.tracks.size() < clip.frames.size())
+				clip.frames.resize(clip.tracks.size());
+			clip.tracks.resize(clip.frames.size());
+		}
+		if (clip.frames.size() < 2)
+			throw runtime_error("The clip needs at least two frames with tracks");
+
+		/* The settings are drawn up front, so a run is reproducible whatever the number of cores */
+		cv::RNG rng(0x5EED);
+		vector<Settings> settings(1, defaultSettings);
+		const int medianBlurs[] = { 3, 5, 7, 9, 11 };
+		const int backgroundRings[] = { 0, 8, 16, 32, 64 };
+		for (int i = 1; i < samples; i++) {
+			Settings sample = {
+				rng.uniform(2, 65),
+				rng.uniform(1, 33),
+				rng.uniform(1, 17),
+				medianBlurs[rng.uniform(0, 5)],
+				rng.uniform(0, 129),
+				backgroundRings[rng.uniform(0, 5)]
+			};
+			settings.push_back(sample);
+		}
+
+		vector<Evaluation> evaluations(settings.size());
+		atomic<size_t> next(0);
+		vector<thread> workers;
+		unsigned cores = max(thread::hardware_concurrency(), 1u);
+		for (unsigned i = 0; i < cores; i++) {
+			workers.push_back(thread([&]() {
+				for (size_t j = next++; j < settings.size(); j = next++)
+					evaluations[j] = evaluate(settings[j], clip);
+			}));
+		}
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		size_t failures = 0;
+		for (size_t i = 0; i < evaluations.size(); i++)
+			failures += evaluations[i].failed;
+
+		vector<Evaluation> front = getParetoFront(evaluations);
+		for (size_t i = 0; i < front.size(); i++)
+			front[i] = evaluate(front[i].settings, clip);
+		front = getParetoFront(front);
+
+		cout << evaluations.size() << " settings over " << clip.frames.size() << " frames on " << cores
+			<< " cores, " << failures << " lost the track" << endl;
+		cout << "default: cost " << fixed << setprecision(3) << evaluate(defaultSettings, clip).cost << " ms, IoU "
+			<< evaluations[0].iou << endl << endl;
+		cout << right << setw(6) << "hue" << setw(6) << "sat" << setw(6) << "val" << setw(8) << "median"
+			<< setw(11) << "threshold" << setw(6) << "ring" << setw(10) << "cost ms" << setw(8) << "IoU" << setw(11) << "center px" << endl;
+		for (size_t i = 0; i < front.size(); i++) {
+			const Settings& s = front[i].settings;
+			cout << setw(6) << s.hueBins << setw(6) << s.satBins << setw(6) << s.valBins << setw(8) << s.medianBlur
+				<< setw(11) << s.threshold << setw(6) << s.backgroundRing << setprecision(3) << setw(10) << front[i].cost
+				<< setw(8) << front[i].iou << setprecision(1) << setw(11) << front[i].centerError << endl;
+		}
+
+	/* Report any errors */
+	} catch (exception& e) {
+		cout << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}